@@ -39,18 +39,20 @@ BenchmarkResult benchmark_causaldb_insert() {
     double start_memory = get_memory_usage();
     
     // Create fresh database
-    system("rm -f benchmark_causal.cdb");
+    system("rm -f benchmark_causal.cdb benchmark_causal.cdb" HEAP_SUFFIX " benchmark_causal.cdb" TEXT_INDEX_SUFFIX);
     open_db("benchmark_causal.cdb");
-    Table* table = malloc(sizeof(Table));
-    table->num_events = 0;
+    Table* table = new_table();
     
     // Insert events
     for (int i = 1; i <= BENCHMARK_ITERATIONS; i++) {
         Event e;
+        char data[64];
         e.id = i;
         e.parent_count = (i > 1) ? 1 : 0;
+        e.more_parents = NULL;
         if (i > 1) e.parents[0] = i - 1;
-        snprintf(e.data, MAX_DATA_LENGTH, "Event %d with causal relationship", i);
+        e.data_length = (uint32_t)snprintf(data, sizeof(data), "Event %d with causal relationship", i);
+        e.data = data;
         
         insert_event(&e, table);
         result.events_processed++;
@@ -60,7 +62,7 @@ BenchmarkResult benchmark_causaldb_insert() {
     result.memory_usage = get_memory_usage() - start_memory;
     
     close_db();
-    free(table);
+    free_table(table);
     return result;
 }
 
@@ -84,7 +86,7 @@ BenchmarkResult benchmark_causaldb_query() {
     result.memory_usage = get_memory_usage() - start_memory;
     
     close_db();
-    free(table);
+    free_table(table);
     return result;
 }
 
@@ -195,11 +197,17 @@ void compare_features() {
 void compare_file_sizes() {
     printf("\n=== FILE SIZE COMPARISON ===\n");
     
-    // Get CausalDB file size
+    // Get CausalDB file size, payload heap included
     FILE* causal_file = fopen("benchmark_causal.cdb", "rb");
     fseek(causal_file, 0, SEEK_END);
     long causal_size = ftell(causal_file);
     fclose(causal_file);
+    FILE* heap_file = fopen("benchmark_causal.cdb" HEAP_SUFFIX, "rb");
+    if (heap_file) {
+        fseek(heap_file, 0, SEEK_END);
+        causal_size += ftell(heap_file);
+        fclose(heap_file);
+    }
     
     // Get SQLite file size
     FILE* sqlite_file = fopen("benchmark_sqlite.db", "rb");
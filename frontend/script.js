@@ -2,6 +2,8 @@
 class CausalDBFrontend {
   constructor() {
     this.events = [];
+    this.eventIds = new Set();
+    this.feed = null;
     this.apiBase = "http://localhost:8080/api";
     this.init();
   }
@@ -98,7 +100,6 @@ class CausalDBFrontend {
 
       this.showMessage("Event added successfully!", "success");
       form.reset();
-      this.loadEvents();
     } catch (error) {
       this.showMessage("Failed to add event: " + error.message, "error");
     }
@@ -126,9 +127,11 @@ class CausalDBFrontend {
   async loadEvents() {
     try {
       this.events = await this.callBackendAPI("events");
+      this.eventIds = new Set(this.events.map((event) => event.id));
       this.renderEvents();
       this.updateStats();
       this.renderGraph();
+      this.subscribe();
     } catch (error) {
       this.showMessage("Failed to load events: " + error.message, "error");
       // Fallback to sample data if server is not running
@@ -139,6 +142,43 @@ class CausalDBFrontend {
     }
   }
 
+  // Follows new events through the server's change feed, starting right
+  // after the last one loaded. EventSource reconnects by itself and resumes
+  // from the last event it received.
+  subscribe() {
+    if (this.feed) {
+      this.feed.close();
+    }
+
+    const last = this.events[this.events.length - 1];
+    const position = last ? `after=${last.id}` : "from=0";
+    this.feed = new EventSource(`${this.apiBase}/events/stream?${position}`);
+    this.feed.onmessage = (message) => {
+      this.appendEvent(JSON.parse(message.data));
+    };
+  }
+
+  appendEvent(event) {
+    if (this.eventIds.has(event.id)) {
+      return;
+    }
+
+    this.events.push(event);
+    this.eventIds.add(event.id);
+    if (this.events.length === 1) {
+      this.renderEvents();
+      this.renderGraph();
+    } else {
+      document
+        .getElementById("eventsList")
+        .appendChild(this.createEventCard(event));
+      document
+        .getElementById("graphEntries")
+        .insertAdjacentHTML("beforeend", this.graphEntryHtml(event));
+    }
+    this.updateStats();
+  }
+
   getSampleData() {
     return [
       {
@@ -282,27 +322,33 @@ class CausalDBFrontend {
 
     // Create a simple text-based graph representation
     // In a real implementation, you'd use a library like D3.js or vis.js
-    let graphHtml = '<div style="font-family: monospace; font-size: 0.9rem;">';
+    let graphHtml =
+      '<div id="graphEntries" style="font-family: monospace; font-size: 0.9rem;">';
 
     this.events.forEach((event) => {
-      graphHtml += `<div style="margin-bottom: 10px;">`;
-      graphHtml += `<strong>${event.id}</strong>: ${this.escapeHtml(
-        event.data.substring(0, 50)
-      )}${event.data.length > 50 ? "..." : ""}`;
-
-      if (event.parents && event.parents.length > 0) {
-        graphHtml += `<br><span style="color: #6b7280; margin-left: 20px;">⬑ from: ${event.parents.join(
-          ", "
-        )}</span>`;
-      }
-
-      graphHtml += `</div>`;
+      graphHtml += this.graphEntryHtml(event);
     });
 
     graphHtml += "</div>";
     graphContainer.innerHTML = graphHtml;
   }
 
+  graphEntryHtml(event) {
+    let entryHtml = `<div style="margin-bottom: 10px;">`;
+    entryHtml += `<strong>${event.id}</strong>: ${this.escapeHtml(
+      event.data.substring(0, 50)
+    )}${event.data.length > 50 ? "..." : ""}`;
+
+    if (event.parents && event.parents.length > 0) {
+      entryHtml += `<br><span style="color: #6b7280; margin-left: 20px;">⬑ from: ${event.parents.join(
+        ", "
+      )}</span>`;
+    }
+
+    entryHtml += `</div>`;
+    return entryHtml;
+  }
+
   exportData() {
     const dataStr = JSON.stringify(this.events, null, 2);
     const dataBlob = new Blob([dataStr], { type: "application/json" });
@@ -2,13 +2,69 @@
 #define DB_H
 
 #include "event.h"
+#include "graph.h"
+
+// Inserts are staged in memory and committed in groups. A background
+// flusher commits a group once it holds LOG_GROUP_MAX_EVENTS events or
+// LOG_GROUP_MAX_BYTES bytes, or is LOG_GROUP_WINDOW_MS old; commit_log()
+// commits it at once.
+#define LOG_GROUP_MAX_EVENTS 256
+#define LOG_GROUP_MAX_BYTES (64 * 1024)
+#define LOG_GROUP_WINDOW_MS 10
+
+typedef struct {
+    size_t bytes_read;   // Bytes of rows kept in the file
+    size_t rows_read;    // Intact rows loaded
+    size_t torn_bytes;   // Interrupted trailing write dropped from the files
+    size_t corrupt_rows; // Rows that failed their checksum mid-file
+} LoadStats;
+
+typedef enum {
+    INSERT_SUCCESS,
+    INSERT_DUPLICATE_ID,
+    INSERT_DATA_TOO_LONG,
+    INSERT_TOO_MANY_PARENTS,
+    INSERT_OUT_OF_MEMORY,
+    INSERT_IO_ERROR
+} InsertResult;
+
+typedef enum {
+    DURABILITY_NONE,  // Write groups out, leave syncing to the OS
+    DURABILITY_GROUP, // One fdatasync per group of inserts
+    DURABILITY_FULL   // insert_event() and insert_events() commit before returning
+} Durability;
 
 void open_db(const char* filename);
 void close_db();
+void set_durability(Durability mode);
+int parse_durability(const char* name, Durability* out);
+// Returns once every event staged so far is written, and synced unless
+// the mode is DURABILITY_NONE. Concurrent callers share one write and one
+// fdatasync per file. Returns 0 on an I/O error.
+int commit_log();
 
-void insert_event(Event* e, Table* table);
+InsertResult insert_event(Event* e, Table* table);
+InsertResult insert_events(Event* batch, size_t n, Table* table);
+// Like insert_events(), but never commits, whatever the mode; callers
+// follow it with commit_log(), which lets concurrent writers share a
+// group.
+InsertResult stage_events(Event* batch, size_t n, Table* table);
+// Applies a batch that insert_events() already wrote to another copy of
+// the table, without writing it again.
+InsertResult replay_events(Event* batch, size_t n, Table* table);
+// Finds the row holding `id`; `row` may be NULL.
+int lookup_row(uint32_t id, Table* table, uint32_t* row);
+// Rows shadowed by an earlier duplicate id are not served.
+int is_served_row(Table* table, uint32_t row);
 int find_event_in_memory(uint32_t id, Table* table, Event* out);
-int read_event_by_id(uint32_t id, Event* out);
+// Rows whose data contains every word of `query`, in insertion order.
+int search_events(Table* table, const char* query, size_t length, Traversal* out);
+// Rebuilds the reachability labels and the text index if an insert left
+// them stale, so that queries only need to read the table.
+int refresh_indexes(Table* table);
+// Writes the text index next to the database file (causal.cdb.fts).
+int save_text_index(Table* table);
 Table* load_table(const char* filename);
+Table* load_table_with_stats(const char* filename, LoadStats* stats);
 
 #endif
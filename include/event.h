@@ -3,33 +3,230 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
+#include "index.h"
+#include "text_index.h"
 
-#define MAX_PARENTS 8
-#define MAX_DATA_LENGTH 128
-#define ROW_SIZE 168
+#define INLINE_PARENTS 2
+#define MAX_PARENTS 1024
+#define MAX_DATA_LENGTH (8 * 1024)
+
+// On-disk format. A file starts with a FILE_HEADER_SIZE header:
+//   [0, 8)   FORMAT_MAGIC
+//   [8, 12)  format version
+//   [12, 16) record size
+//   [60, 64) CRC-32C of bytes [0, 60)
+// followed by ROW_SIZE records. All integers are little-endian. Two
+// records fit in a cache line, so after the header no record straddles
+// one; the last four bytes of a record hold the CRC-32C of the rest.
+//
+// Everything that does not fit in a record lives in a separate
+// append-only heap file (<file>.heap). An event's heap entry holds its
+// parents beyond the first INLINE_PARENTS, then its payload and a NUL, so
+// that the payload can be used in place as a C string. The record holds
+// the entry's offset and its CRC-32C (NUL excluded).
+#define FORMAT_MAGIC "CAUSALDB"
+#define FORMAT_VERSION 3
+#define FILE_HEADER_SIZE 64
+#define FILE_HEADER_CRC_OFFSET 60
+#define ROW_SIZE 32
+#define HEAP_SUFFIX ".heap"
+
+#define RECORD_ID_OFFSET 0
+#define RECORD_PARENT_COUNT_OFFSET 4  // uint16
+#define RECORD_DATA_LENGTH_OFFSET 6   // uint16
+#define RECORD_HEAP_OFFSET 8          // uint64
+#define RECORD_PARENTS_OFFSET 16
+#define RECORD_HEAP_CRC_OFFSET 24
+#define RECORD_CRC_OFFSET (ROW_SIZE - 4)
 
 typedef struct {
     uint32_t id;
-    uint8_t parent_count;
-    uint32_t parents[MAX_PARENTS];
-    char data[MAX_DATA_LENGTH];
+    uint32_t parent_count;
+    uint32_t parents[INLINE_PARENTS];
+    // The remaining parent_count - INLINE_PARENTS parents, if any.
+    const uint32_t* more_parents;
+    uint32_t data_length;
+    // data_length bytes. Only events stored in a Table are guaranteed to
+    // be NUL-terminated; parsed events point into their input.
+    const char* data;
 } Event;
 
-#define TABLE_MAX_EVENTS 1000
+static inline uint32_t event_parent(const Event* e, uint32_t i) {
+    return i < INLINE_PARENTS ? e->parents[i] : e->more_parents[i - INLINE_PARENTS];
+}
+
+static inline uint32_t event_overflow_count(const Event* e) {
+    return e->parent_count > INLINE_PARENTS ? e->parent_count - INLINE_PARENTS : 0;
+}
+
+#define BLOB_BLOCK_SIZE (64 * 1024)
+
+// Append-only arena for event payloads and overflow parents. Blocks are
+// never moved or freed before the heap itself, so Event.data and
+// Event.more_parents pointers into it stay valid.
+typedef struct {
+    char** blocks;
+    size_t num_blocks;
+    size_t max_blocks;
+    size_t used;     // Bytes handed out from the last block
+    size_t capacity; // Size of the last block
+} BlobHeap;
+
+void blob_heap_init(BlobHeap* heap);
+void blob_heap_free(BlobHeap* heap);
+// Makes sure the next `bytes` bytes of allocations cannot fail.
+int blob_heap_reserve(BlobHeap* heap, size_t bytes);
+char* blob_heap_alloc(BlobHeap* heap, size_t bytes);
+
+// Parses parent ids separated by whitespace or commas into `e`, stopping
+// at the first character that cannot start an id. Parents beyond the
+// inline ones are allocated from `overflow`. Returns the position after
+// the list, or NULL if `overflow` is out of memory.
+char* parse_parent_list(const char* p, Event* e, BlobHeap* overflow);
 
+#define TABLE_MIN_CAPACITY 1024
+
+// Events are stored column by column, so that a scan over ids or over the
+// graph's edges only touches the columns it needs. The parents of every
+// row are concatenated in `parents`; row r's list starts at
+// parent_offsets[r]. Columns are reallocated as the table grows, so refer
+// to rows by number rather than by pointer.
 typedef struct {
-    Event events[TABLE_MAX_EVENTS];
     size_t num_events;
+    size_t capacity;
+    uint32_t* ids;
+    uint32_t* parent_counts;
+    uint32_t* parent_offsets;
+    uint32_t* data_lengths;
+    const char** data;     // NUL-terminated, in `heap` or `mapped_heap`
+    uint32_t* parents;
+    size_t num_parents;
+    size_t parents_capacity;
+    IdIndex id_index;    // Event id -> row number
+    ChildIndex children; // Parent id -> rows that list it as a parent
+    ReachIndex reach;    // Per-row labels for happens-before queries
+    TextIndex text;      // Word -> rows whose data contains it
+    BlobHeap heap;       // Payloads of events inserted since the table was loaded
+    struct MappedFile* mapped_heap; // The heap file as loaded (mapped.h), or NULL
 } Table;
 
-static inline Event* event_slot(Table* table, size_t row_num) {
-    return &table->events[row_num];
+static inline const uint32_t* table_parents(const Table* table, size_t row) {
+    return table->parents + table->parent_offsets[row];
+}
+
+Table* new_table();
+void free_table(Table* table);
+// Makes room for `rows` events with `parents` parent ids in total.
+int table_reserve(Table* table, size_t rows, size_t parents);
+// Appends `e`, copying its parents. Its data must stay valid for the
+// lifetime of the table.
+int table_append(Table* table, const Event* e);
+// Fills `out` with a view of `row`, valid until the table next grows.
+void table_event(const Table* table, size_t row, Event* out);
+
+static inline uint32_t load_le32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void store_le32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint64_t load_le64(const uint8_t* p) {
+    return (uint64_t)load_le32(p) | (uint64_t)load_le32(p + 4) << 32;
+}
+
+static inline void store_le64(uint8_t* p, uint64_t v) {
+    store_le32(p, (uint32_t)v);
+    store_le32(p + 4, (uint32_t)(v >> 32));
 }
 
-// 🔽 ADD THESE LINES:
-void serialize_event(Event* src, void* dest);
-void deserialize_event(void* src, Event* dest);
+// Unsigned LEB128: seven bits per byte, low bits first.
+#define VARINT_MAX_BYTES 5
 
+static inline size_t put_varint(uint8_t* out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// Decodes a varint at `*p`, which must end before `end`. Returns 0 if it
+// runs past `end` or is too long.
+static inline int get_varint(const uint8_t** p, const uint8_t* end, uint32_t* value) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35 && *p < end; shift += 7) {
+        uint8_t byte = *(*p)++;
+        result |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Size of the heap entry for `e`, terminating NUL included.
+static inline size_t heap_entry_size(const Event* e) {
+    return 4 * (size_t)event_overflow_count(e) + e->data_length + 1;
+}
+
+void serialize_heap_entry(const Event* src, char* dest);
+// Writes the record for `src`, whose heap entry `entry` is stored at
+// `heap_offset` in the heap file.
+void serialize_event(const Event* src, uint64_t heap_offset, const char* entry, void* dest);
+// Fills `dest` from a record whose entry in `heap` has passed
+// record_heap_valid(). Its data points into `heap`; overflow parents are
+// decoded into `more_parents`, which must have room for
+// record_overflow_count() of them.
+void deserialize_event(const void* src, const char* heap, uint32_t* more_parents, Event* dest);
+int record_valid(const uint8_t* record);
+// Checks that the record's heap entry lies within the first `heap_size`
+// bytes of `heap` and matches its checksum.
+int record_heap_valid(const uint8_t* record, const char* heap, size_t heap_size);
+void heap_filename(const char* filename, char* out, size_t out_size);
+
+void write_file_header(uint8_t* dest);
+// Returns 0 if `header` is not a CausalDB header, otherwise stores the
+// format version it declares.
+int read_file_header(const uint8_t* header, uint32_t* version);
+
+// Zero-copy accessors for a serialized record, e.g. one in a read block.
+static inline uint32_t record_id(const uint8_t* record) {
+    return load_le32(record + RECORD_ID_OFFSET);
+}
+
+static inline uint32_t record_parent_count(const uint8_t* record) {
+    return (uint32_t)record[RECORD_PARENT_COUNT_OFFSET] | (uint32_t)record[RECORD_PARENT_COUNT_OFFSET + 1] << 8;
+}
+
+static inline uint32_t record_overflow_count(const uint8_t* record) {
+    uint32_t count = record_parent_count(record);
+    return count > INLINE_PARENTS ? count - INLINE_PARENTS : 0;
+}
+
+// Only the first INLINE_PARENTS parents are in the record itself.
+static inline uint32_t record_parent(const uint8_t* record, uint32_t i) {
+    return load_le32(record + RECORD_PARENTS_OFFSET + 4 * i);
+}
 
+static inline uint64_t record_heap_offset(const uint8_t* record) {
+    return load_le64(record + RECORD_HEAP_OFFSET);
+}
+
+static inline uint32_t record_data_length(const uint8_t* record) {
+    return (uint32_t)record[RECORD_DATA_LENGTH_OFFSET] | (uint32_t)record[RECORD_DATA_LENGTH_OFFSET + 1] << 8;
+}
+
+static inline const char* record_entry_data(const uint8_t* record, const char* entry) {
+    return entry + 4 * (size_t)record_overflow_count(record);
+}
 
 #endif
@@ -0,0 +1,87 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdio.h>
+#include "event.h"
+
+// Binary export: an EXPORT_HEADER_SIZE header followed by WIRE_EVENTS
+// frames (see wire.h) in insertion order, the last of them empty so that
+// a cut-off export can be told from a complete one. Frames hold records
+// and heap entries exactly as causal.cdb does; each can be decoded with
+// wire_read_batch() or sent back to a server as a WIRE_INSERT frame.
+//   [0, 8)   EXPORT_MAGIC
+//   [8, 12)  record format version (FORMAT_VERSION)
+//   [12, 16) record size
+//   [60, 64) CRC-32C of bytes [0, 60)
+#define EXPORT_MAGIC "CAUSALEX"
+#define EXPORT_HEADER_SIZE 64
+#define EXPORT_HEADER_CRC_OFFSET 60
+#define EXPORT_FRAME_EVENTS 512
+
+// Columnar export, laid out to be memory-mapped and read in place. After
+// a COLUMNAR_HEADER_SIZE header come the sections of ColumnarSection,
+// each starting at a multiple of 8 bytes:
+//   [0, 8)     COLUMNAR_MAGIC
+//   [8, 12)    COLUMNAR_VERSION
+//   [12, 16)   event count N
+//   [16, 20)   distinct payload count D
+//   [24, 120)  offset and size in bytes (uint64 each) of every section
+//   [124, 128) CRC-32C of bytes [0, 124)
+// All integers are little-endian.
+#define COLUMNAR_MAGIC "CAUSALCO"
+#define COLUMNAR_VERSION 1
+#define COLUMNAR_HEADER_SIZE 128
+#define COLUMNAR_SECTIONS_OFFSET 24
+#define COLUMNAR_HEADER_CRC_OFFSET 124
+
+typedef enum {
+    COLUMN_IDS,           // N uint32 event ids, in insertion order
+    COLUMN_EDGE_OFFSETS,  // N + 1 uint64: row r's parents are EDGES bytes [off[r], off[r + 1])
+    COLUMN_EDGES,         // Per row, varints: the parent count, then each parent as the
+                          // zigzag-coded difference (mod 2^32) from the row's id for the
+                          // first and from the previous parent after that
+    COLUMN_PAYLOAD_CODES, // N uint32: each row's payload in the dictionary
+    COLUMN_DICT_OFFSETS,  // D + 1 uint64: payload d is DICT bytes [off[d], off[d + 1] - 1)
+    COLUMN_DICT,          // Distinct payloads in order of first use, each followed by a NUL
+    COLUMN_COUNT
+} ColumnarSection;
+
+// Builds a columnar export a block of rows at a time, keeping its own
+// copy of everything it writes so that the table need only be held while
+// a block is added. Rows below `end_row` must read the same in every
+// table passed in, as they do in each snapshot (snapshot.h).
+typedef struct {
+    uint32_t next_row;      // First row not yet added
+    uint32_t end_row;
+    size_t count;           // Rows added, each with an entry in the arrays below
+    uint32_t* ids;
+    uint32_t* codes;
+    uint64_t* edge_offsets; // count + 1 of them, as in COLUMN_EDGE_OFFSETS
+    uint8_t* edges;
+    size_t edges_capacity;
+    uint64_t* dict_offsets; // num_codes + 1 of them, as in COLUMN_DICT_OFFSETS
+    size_t num_codes;
+    size_t max_codes;
+    char* dict;
+    size_t dict_capacity;
+    uint32_t* slots;        // Payload hash table: code + 1, 0 if empty
+    size_t num_slots;
+} ColumnarExport;
+
+void write_export_header(uint8_t* dest);
+
+// Both write the events the table serves, in insertion order. Return 0
+// if out of memory or `out` could not be written.
+int export_binary(Table* table, FILE* out);
+int export_columnar(Table* table, FILE* out);
+
+// columnar_begin() and columnar_add_rows() return 0 if out of memory,
+// columnar_write() as above. columnar_add_rows() adds up to `max_rows`
+// more rows; the export is complete once next_row reaches end_row. The
+// builder must be freed even if columnar_begin() fails.
+int columnar_begin(ColumnarExport* builder, uint32_t end_row);
+int columnar_add_rows(ColumnarExport* builder, Table* table, uint32_t max_rows);
+int columnar_write(const ColumnarExport* builder, FILE* out);
+void columnar_free(ColumnarExport* builder);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include "event.h"
+
+typedef enum {
+    TRAVERSE_ANCESTORS,
+    TRAVERSE_DESCENDANTS
+} TraversalDirection;
+
+// Result of a breadth-first walk: the rows reached, nearest first. The
+// starting event itself is not included.
+typedef struct {
+    uint32_t* rows;
+    size_t count;
+    int truncated; // Non-zero if the walk stopped because of `limit`
+} Traversal;
+
+// Walks the causal graph from `id`. A `max_depth` or `limit` of 0 means
+// unbounded. Returns 0 if `id` is not in the table or memory runs out.
+int traverse(Table* table, uint32_t id, TraversalDirection direction,
+             uint32_t max_depth, size_t limit, Traversal* out);
+void free_traversal(Traversal* traversal);
+// Keeps only the rows of `rows` that `within` also reached, in their
+// original order.
+int intersect_traversal(Table* table, Traversal* rows, const Traversal* within);
+
+// Computes reachability labels for a newly appended row whose parents are
+// already labeled. Returns 0 if out of memory.
+int reach_label_row(Table* table, uint32_t row);
+// Relabels every row in topological order.
+int reach_rebuild(Table* table);
+// Sets *result to 1 if event `a` is a proper causal ancestor of event `b`.
+// Returns 0 if memory runs out before that can be decided.
+int precedes(Table* table, uint32_t a, uint32_t b, int* result);
+// Finds the nearest common ancestors of `a` and `b` (their merge bases);
+// an event counts as its own ancestor here. Returns 0 if either event is
+// missing or memory runs out.
+int common_ancestors(Table* table, uint32_t a, uint32_t b, Traversal* out);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include "event.h"
+
+#define IMPORT_BATCH_EVENTS 1024
+
+typedef struct {
+    size_t imported; // Events written to the database
+    size_t skipped;  // Events whose id already existed
+    size_t invalid;  // Lines that could not be parsed
+    int write_failed; // Writing to disk failed; the import stopped there
+} ImportStats;
+
+// Parses one JSON event object ({"id":..,"data":"..","parents":[..]})
+// starting at *json and advances *json past it. The data string is
+// unescaped in place and the event points at it; parents beyond the
+// inline ones are allocated from `overflow`. Returns 0 on malformed input.
+int parse_event_json(char** json, Event* out, BlobHeap* overflow);
+// Parses one CSV line of the form: id,data,parent1 parent2 ...
+// The data field may be double-quoted, with "" for a literal quote; it is
+// unquoted in place and the event points at it.
+int parse_event_csv(char* line, Event* out, BlobHeap* overflow);
+// Streams a .csv or .jsonl file into the table in batches.
+int import_file(const char* filename, Table* table, ImportStats* stats);
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ID_INDEX_MIN_CAPACITY 64
+
+// Open-addressing hash map from a 32-bit key (an event id) to a 32-bit
+// value, using linear probing. Slots store value + 1 so that 0 can mark an
+// empty slot without reserving any key.
+typedef struct {
+    uint32_t* keys;
+    uint32_t* values;
+    size_t capacity; // Always a power of two
+    size_t count;
+} IdIndex;
+
+void id_index_init(IdIndex* index);
+void id_index_free(IdIndex* index);
+int id_index_reserve(IdIndex* index, size_t count);
+int id_index_get(const IdIndex* index, uint32_t key, uint32_t* value);
+int id_index_put(IdIndex* index, uint32_t key, uint32_t value);
+
+#define EDGE_NONE UINT32_MAX
+
+// Reverse (parent -> children) adjacency. Every edge lives in one shared
+// arena; each parent id maps to a list of edges chained through `next`,
+// kept in insertion order.
+typedef struct {
+    uint32_t child_row;
+    uint32_t next;
+} ChildEdge;
+
+typedef struct {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t count;
+} ChildList;
+
+typedef struct {
+    IdIndex lists;     // Parent id -> slot in `list_slots`
+    ChildList* list_slots;
+    size_t num_lists;
+    size_t max_lists;
+    ChildEdge* edges;
+    size_t num_edges;
+    size_t max_edges;
+} ChildIndex;
+
+void child_index_init(ChildIndex* index);
+void child_index_free(ChildIndex* index);
+int child_index_reserve(ChildIndex* index, size_t parents, size_t edges);
+int child_index_add(ChildIndex* index, uint32_t parent_id, uint32_t child_row);
+const ChildList* child_index_list(const ChildIndex* index, uint32_t parent_id);
+
+#define REACH_UNLABELED UINT32_MAX
+#define REACH_PARTIAL UINT32_MAX
+#define REACH_MAX_LABEL 128
+
+// One entry of a row's label: the furthest position on `chain` that
+// holds an ancestor of the row.
+typedef struct {
+    uint32_t chain;
+    uint32_t position;
+} ReachEntry;
+
+// Per-row reachability labels. Rows are split into chains, each a path
+// on which every row is a parent of the next. A row records its chain,
+// its position on it and, sorted by chain, a ReachEntry for every other
+// chain holding one of its ancestors, so `a` precedes `b` exactly when
+// b's label reaches a's position on a's chain. A row that continues its
+// only parent's chain shares that parent's label. A row's generation is
+// one more than the largest generation among its parents, so an ancestor
+// always has a smaller generation than its descendants.
+// Rows caught in a cycle stay REACH_UNLABELED. Rows whose label would
+// exceed REACH_MAX_LABEL entries, and their descendants, keep only a
+// generation and have a label_count of REACH_PARTIAL.
+typedef struct {
+    uint32_t* generation;
+    uint32_t* chain;
+    uint32_t* position;
+    size_t* label_start;     // Index of the row's first entry in `entries`
+    uint32_t* label_count;
+    uint32_t* chain_lengths; // Rows on each chain so far
+    size_t capacity;
+    uint32_t num_chains;
+    ReachEntry* entries;
+    size_t num_entries;
+    size_t entry_capacity;
+    int stale;               // An event arrived after its children; rebuild before use
+} ReachIndex;
+
+void reach_index_init(ReachIndex* index);
+void reach_index_free(ReachIndex* index);
+int reach_index_reserve(ReachIndex* index, size_t rows);
+int reach_index_reserve_entries(ReachIndex* index, size_t entries);
+
+#endif
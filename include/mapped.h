@@ -0,0 +1,28 @@
+#ifndef MAPPED_H
+#define MAPPED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A read-only, shared mapping of the start of a file. Tables loaded from
+// the same database point their payloads into one mapping of its heap
+// instead of each holding a copy, so the bytes live once, in the page
+// cache, which other processes mapping the file share too.
+typedef struct MappedFile {
+    const char* base; // NULL if nothing was mapped
+    size_t size;
+    uint64_t device;
+    uint64_t inode;
+    int refs;
+    struct MappedFile* next;
+} MappedFile;
+
+// Maps the first `size` bytes of `fd`, or hands out another reference to
+// a mapping of the same file already in use that covers them. Returns
+// NULL on failure. Not thread-safe: tables are loaded and freed by one
+// thread at a time.
+MappedFile* mapped_open(int fd, size_t size);
+// Unmaps the file once its last user has released it.
+void mapped_release(MappedFile* file);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Vectorized scans over columns and payloads. Each uses AVX2 or SSE2
+// depending on what the CPU supports, and plain C elsewhere.
+
+// Returns the index of the first element equal to `key`, or `count` if
+// there is none.
+size_t scan_u32(const uint32_t* values, size_t count, uint32_t key);
+
+// Returns the first occurrence of `needle` in `haystack`, or NULL. Neither
+// needs to be NUL-terminated.
+const char* scan_substring(const char* haystack, size_t length, const char* needle, size_t needle_length);
+
+#endif
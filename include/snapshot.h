@@ -0,0 +1,56 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <pthread.h>
+#include "db.h"
+
+// Readers are counted per slot so that threads on different cores do not
+// contend on one counter. Any number of readers may share a slot.
+#define SNAPSHOT_READER_SLOTS 64
+#define SNAPSHOT_CACHE_LINE 64
+
+typedef struct {
+    long count;
+    char pad[SNAPSHOT_CACHE_LINE - sizeof(long)];
+} SnapshotReaders;
+
+// Two copies of the table for one writer and many readers. Readers use
+// the published copy without ever waiting; the writer applies a batch to
+// the other copy, publishes it, waits until the last reader has left the
+// old copy and then replays the batch onto that one too. A reader thus
+// always sees every event of a batch or none of them, and the copy it
+// holds never changes underneath it.
+typedef struct {
+    Table* tables[2];
+    int published; // Index of the copy readers use
+    SnapshotReaders readers[2][SNAPSHOT_READER_SLOTS];
+    pthread_mutex_t writer;
+} SnapshotStore;
+
+// Loads `filename` into both copies.
+void snapshot_store_open(SnapshotStore* store, const char* filename, LoadStats* stats);
+void snapshot_store_close(SnapshotStore* store);
+
+// Returns the published table, which stays valid and unchanged until the
+// matching snapshot_release(). `slot` is any number, ideally one per
+// thread. The table must only be read; its indexes are already rebuilt.
+Table* snapshot_acquire(SnapshotStore* store, unsigned slot, int* side);
+void snapshot_release(SnapshotStore* store, unsigned slot, int side);
+
+// One batch for snapshot_insert(), which sets `result`.
+typedef struct SnapshotWrite {
+    Event* events;
+    size_t count;
+    InsertResult result;
+    struct SnapshotWrite* next;
+} SnapshotWrite;
+
+// Inserts each batch of the list `writes` as insert_events() does, all of
+// a batch or none of it, makes them visible to readers with a single
+// publish and returns once they are committed. Callers are serialized
+// while they apply their batches but share commits. Readers may see a
+// batch shortly before it is on disk; if the commit fails, it stays
+// visible and its result is INSERT_IO_ERROR.
+void snapshot_insert(SnapshotStore* store, SnapshotWrite* writes);
+
+#endif
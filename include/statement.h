@@ -6,16 +6,45 @@
 typedef enum {
     STATEMENT_INSERT,
     STATEMENT_GET,
+    STATEMENT_CHILDREN,
+    STATEMENT_ANCESTORS,
+    STATEMENT_DESCENDANTS,
+    STATEMENT_PRECEDES,
+    STATEMENT_COMMON_ANCESTORS,
+    STATEMENT_FIND,
+    STATEMENT_SEARCH,
     STATEMENT_UNKNOWN
 } StatementType;
 
+#define STATEMENT_MAX_EVENTS 64
+
+typedef enum {
+    SEARCH_ALL,
+    SEARCH_ANCESTORS,  // Only ancestors of query_id
+    SEARCH_DESCENDANTS // Only descendants of query_id
+} SearchScope;
+
 typedef struct {
     StatementType type;
-    Event event;       // For insert
-    uint32_t query_id; // For get
+    Event events[STATEMENT_MAX_EVENTS]; // For insert
+    size_t event_count;                 // For insert
+    BlobHeap overflow;                  // Parents of insert events beyond the inline ones
+    uint32_t query_id; // For get, children and graph queries
+    uint32_t other_id; // For precedes and common_ancestors
+    uint32_t depth;    // For traversals, 0 = unbounded
+    uint32_t limit;    // For traversals, 0 = unbounded
+    const char* pattern;     // For find and search, points into the input
+    uint32_t pattern_length; // For find and search
+    SearchScope scope;       // For search
 } Statement;
 
+void print_row(Table* table, size_t row);
+
+// The data of parsed insert events and the pattern of a find point into
+// `input`, which must stay alive until the statement has been executed.
 StatementType parse_statement(const char* input, Statement* statement);
+// Releases what parse_statement() allocated, whether or not it succeeded.
+void free_statement(Statement* statement);
 int execute_statement(Statement* stmt, Table* table);
 
 #endif
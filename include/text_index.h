@@ -0,0 +1,58 @@
+#ifndef TEXT_INDEX_H
+#define TEXT_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Words are runs of letters, digits and non-ASCII bytes, matched without
+// regard to ASCII case. Longer words are cut to this many bytes.
+#define TEXT_TOKEN_MAX 32
+
+#define TEXT_INDEX_SUFFIX ".fts"
+#define TEXT_INDEX_MAGIC "CDBTEXT1"
+#define TEXT_INDEX_VERSION 1
+#define TEXT_INDEX_HEADER_SIZE 32
+
+// One word and the rows that contain it. Rows are added in ascending
+// order and stored as varint-encoded gaps from the previous row.
+typedef struct {
+    uint32_t token_offset; // Into TextIndex.tokens
+    uint32_t token_length;
+    uint8_t* postings;
+    size_t size;
+    size_t capacity;
+    uint32_t count;
+    uint32_t last_row;
+} TextTerm;
+
+// Inverted index from word to the rows whose data contains it.
+typedef struct {
+    TextTerm* terms;
+    size_t num_terms;
+    size_t max_terms;
+    uint32_t* buckets;      // Term number + 1, 0 = empty
+    size_t bucket_capacity; // Always a power of two
+    char* tokens;           // Term text, back to back
+    size_t tokens_size;
+    size_t tokens_capacity;
+    int stale;              // Rows are missing; rebuild before searching
+} TextIndex;
+
+void text_index_init(TextIndex* index);
+void text_index_free(TextIndex* index);
+// Indexes the words of `data` under `row`, which must not be lower than
+// any row added before.
+int text_index_add(TextIndex* index, uint32_t row, const char* data, size_t length);
+// Finds the rows containing every word of `query`, ascending. The caller
+// frees `*rows`. A query without words matches nothing.
+int text_index_search(const TextIndex* index, const char* query, size_t length,
+                      uint32_t** rows, size_t* count);
+
+// Writes the index to `filename`, recording that it covers the first
+// `rows` rows of the table and a `check` value identifying the last one.
+int text_index_save(const TextIndex* index, const char* filename, uint32_t rows, uint32_t check);
+// Replaces `index` with the one saved in `filename`. Returns 0, leaving
+// `index` empty, if the file is missing or damaged.
+int text_index_load(TextIndex* index, const char* filename, uint32_t* rows, uint32_t* check);
+
+#endif
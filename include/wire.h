@@ -0,0 +1,60 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "event.h"
+
+// Binary protocol for producers and subscribers. A connection carries a
+// sequence of frames in each direction. Every frame starts with a
+// WIRE_HEADER_SIZE header:
+//   [0, 4)  frame length, header included
+//   [4, 8)  frame type (WireType)
+//   [8, 12) tag, chosen by the client and echoed in the reply
+// All integers are little-endian.
+//
+// WIRE_INSERT and WIRE_EVENTS frames carry a batch of events laid out
+// like a database file and its heap:
+//   [0, 4)  event count
+//   [4, 8)  cursor: for WIRE_EVENTS, the position to resume from
+//   count ROW_SIZE records, as written by serialize_event()
+//   the heap entries, each record's heap offset counting from here
+#define WIRE_HEADER_SIZE 12
+#define WIRE_BATCH_HEADER_SIZE 8
+#define WIRE_MAX_FRAME (64 * 1024 * 1024)
+#define WIRE_SUBSCRIBE_FROM_END 0xFFFFFFFFu
+
+typedef enum {
+    WIRE_INSERT = 1,    // Client: a batch of events to insert, all or nothing
+    WIRE_ACK = 2,       // Server: [0, 4) WireStatus, [4, 8) events inserted
+    WIRE_SUBSCRIBE = 3, // Client: [0, 4) position to tail from, or WIRE_SUBSCRIBE_FROM_END
+    WIRE_EVENTS = 4     // Server: a batch of events inserted at or after that position
+} WireType;
+
+// Statuses up to INSERT_IO_ERROR are InsertResult values.
+typedef enum {
+    WIRE_OK = 0,
+    WIRE_MALFORMED = 100, // The frame could not be decoded; the connection is closed
+    WIRE_UNKNOWN_TYPE = 101,
+    WIRE_EMPTY_DATA = 102 // An event in the batch has no data; nothing was inserted
+} WireStatus;
+
+void wire_write_header(uint8_t* dest, uint32_t length, WireType type, uint32_t tag);
+
+// Size of a frame holding `events`.
+size_t wire_batch_size(const Event* events, size_t count);
+// Writes a frame holding `events` to `dest`, which must have room for
+// wire_batch_size() bytes.
+void wire_write_batch(uint8_t* dest, WireType type, uint32_t tag, uint32_t cursor,
+                      const Event* events, size_t count);
+// Decodes the batch in the `length` bytes of `body` (a frame without its
+// header) into `events`, which must have room for the count it starts
+// with. The events point into `body`; parents beyond the inline ones are
+// allocated from `overflow`. Returns 0 if the batch is damaged.
+int wire_read_batch(const uint8_t* body, size_t length, Event* events, BlobHeap* overflow);
+
+static inline uint32_t wire_batch_count(const uint8_t* body) {
+    return load_le32(body);
+}
+
+#endif
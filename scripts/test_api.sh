@@ -41,4 +41,258 @@ echo "5. Testing GET /api/events (final state)..."
 curl -s http://localhost:8080/api/events
 echo -e "\n"
 
-echo "API tests completed!" 
\ No newline at end of file
+FAILED=0
+
+# Reports whether "$2" contains "$3".
+check() {
+    if [[ "$2" == *"$3"* ]]; then
+        echo "   PASS: $1"
+    else
+        echo "   FAIL: $1 (got: ${2:0:200})"
+        FAILED=1
+    fi
+}
+
+# Sends each argument to the server as a separate write, pausing in
+# between so that they arrive in separate reads, and prints the status
+# code of every response. The last request must close the connection.
+raw_request() {
+    exec 3<>/dev/tcp/localhost/8080
+    for part in "$@"; do
+        printf '%s' "$part" >&3
+        sleep 0.2
+    done
+    timeout 5 cat <&3 | grep -ao 'HTTP/1\.1 [0-9][0-9][0-9]'
+    exec 3<&-
+}
+
+# Test 6: A request whose headers and body are split across reads
+echo "6. Testing a request split across reads..."
+body='{"id": 10, "data": "Split", "parents": [1]}'
+status=$(raw_request $'POST /api/events HTTP/1.1\r\nContent-Le' \
+    $'ngth: '${#body}$'\r\nConnection: close\r\n\r\n'"${body:0:12}" "${body:12}")
+check "split request inserted" "$status" "HTTP/1.1 201"
+check "split event readable" "$(curl -s http://localhost:8080/api/events/10)" '"data":"Split"'
+echo
+
+# Test 7: Pipelined requests are answered in order, and a read queued
+# behind an insert sees it
+echo "7. Testing pipelined requests..."
+body='{"id": 11, "data": "Pipelined", "parents": [10]}'
+status=$(raw_request $'GET /api/events/1 HTTP/1.1\r\n\r\n'$'POST /api/events HTTP/1.1\r\nContent-Length: '${#body}$'\r\n\r\n'"$body"$'GET /api/events/11 HTTP/1.1\r\nConnection: close\r\n\r\n')
+check "responses in order" "$(echo $status)" "HTTP/1.1 200 HTTP/1.1 201 HTTP/1.1 200"
+echo
+
+# Test 8: Oversized and unsupported requests are refused
+echo "8. Testing oversized requests..."
+status=$(raw_request $'POST /api/events HTTP/1.1\r\nContent-Length: 100000000\r\nConnection: close\r\n\r\n')
+check "body over the limit" "$status" "HTTP/1.1 413"
+long_path=$(head -c 3000 /dev/zero | tr '\0' a)
+check "path over the limit" "$(curl -s -o /dev/null -w '%{http_code}' "http://localhost:8080/$long_path")" "414"
+long_header=$(head -c 9000 /dev/zero | tr '\0' a)
+check "headers over the limit" \
+    "$(curl -s -o /dev/null -w '%{http_code}' -H "X-Padding: $long_header" http://localhost:8080/api/events/1)" "431"
+check "chunked upload" "$(curl -s -o /dev/null -w '%{http_code}' -X POST -H 'Transfer-Encoding: chunked' \
+    -d '{"id": 99, "data": "x", "parents": []}' http://localhost:8080/api/events)" "501"
+echo
+
+# Test 9: A WIRE_INSERT frame on the binary port is acknowledged and its
+# events are served over HTTP
+echo "9. Testing WIRE_INSERT and WIRE_ACK on port 8081..."
+ack=$(python3 - <<'PYTHON'
+import socket, struct
+
+def crc32c(data):
+    crc = 0xFFFFFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ (0x82F63B78 if crc & 1 else 0)
+    return crc ^ 0xFFFFFFFF
+
+# Events 12 and 13; 13 has more parents than fit in its record
+records = heap = b""
+for event_id, parents, data in [(12, [1], b"Wire"), (13, [12, 10, 11], b"Wire child")]:
+    entry = b"".join(struct.pack("<I", p) for p in parents[2:]) + data
+    inline = (parents + [0, 0])[:2]
+    record = struct.pack("<IHHQIII", event_id, len(parents), len(data), len(heap),
+                         inline[0], inline[1], crc32c(entry))
+    records += record + struct.pack("<I", crc32c(record))
+    heap += entry + b"\0"
+body = struct.pack("<II", 2, 0) + records + heap
+sock = socket.create_connection(("localhost", 8081))
+sock.sendall(struct.pack("<III", 12 + len(body), 1, 7) + body)
+reply = b""
+while len(reply) < 20:
+    reply += sock.recv(20 - len(reply))
+length, frame_type, tag, status, count = struct.unpack("<IIIII", reply)
+print("type=%d tag=%d status=%d count=%d" % (frame_type, tag, status, count))
+PYTHON
+)
+check "insert acknowledged" "$ack" "type=2 tag=7 status=0 count=2"
+check "wire event readable" "$(curl -s http://localhost:8080/api/events/13)" '"parents":[12,10,11]'
+echo
+
+# Test 10: The event feed resumes after the position given in
+# Last-Event-ID; events 12 and 13 are the 5th and 6th
+echo "10. Testing event feed resume with Last-Event-ID..."
+feed=$(curl -s -N --max-time 1 -H "Last-Event-ID: 4" http://localhost:8080/api/events/stream)
+check "resumes at the next position" "$feed" $'id: 5\ndata: {"id":12'
+check "continues to the end" "$feed" $'id: 6\ndata: {"id":13'
+if [[ "$feed" == *'"id":11'* ]]; then
+    echo "   FAIL: replayed an event before the resume point"
+    FAILED=1
+fi
+echo
+
+# Test 11: precedes on a diamond (20 -> 21, 22 -> 23), then on event 25,
+# whose parent 24 only arrives after it and leaves the labels stale
+echo "11. Testing precedes..."
+curl -s -X POST http://localhost:8080/api/events -H "Content-Type: application/json" \
+  -d '[{"id": 20, "data": "Root", "parents": []},
+       {"id": 21, "data": "Left", "parents": [20]},
+       {"id": 22, "data": "Right", "parents": [20]},
+       {"id": 23, "data": "Merge", "parents": [21, 22]}]' > /dev/null
+check "root precedes merge" "$(curl -s http://localhost:8080/api/events/20/precedes/23)" '"precedes":true'
+check "merge does not precede root" "$(curl -s http://localhost:8080/api/events/23/precedes/20)" '"precedes":false'
+check "siblings are concurrent" "$(curl -s http://localhost:8080/api/events/21/precedes/22)" '"precedes":false'
+check "an event does not precede itself" "$(curl -s http://localhost:8080/api/events/21/precedes/21)" '"precedes":false'
+curl -s -X POST http://localhost:8080/api/events -H "Content-Type: application/json" \
+  -d '{"id": 25, "data": "Late child", "parents": [24]}' > /dev/null
+check "unknown parent does not precede" "$(curl -s http://localhost:8080/api/events/22/precedes/25)" '"precedes":false'
+curl -s -X POST http://localhost:8080/api/events -H "Content-Type: application/json" \
+  -d '{"id": 24, "data": "Late parent", "parents": [23]}' > /dev/null
+check "late parent precedes its child" "$(curl -s http://localhost:8080/api/events/24/precedes/25)" '"precedes":true'
+check "relabeled through the late parent" "$(curl -s http://localhost:8080/api/events/22/precedes/25)" '"precedes":true'
+check "child does not precede the root" "$(curl -s http://localhost:8080/api/events/25/precedes/20)" '"precedes":false'
+echo
+
+# Test 12: common_ancestors returns the nearest shared ancestors only;
+# 26 merges 21 and 22 the other way round from 23, so both are bases
+echo "12. Testing common_ancestors..."
+curl -s -X POST http://localhost:8080/api/events -H "Content-Type: application/json" \
+  -d '{"id": 26, "data": "Criss-cross", "parents": [22, 21]}' > /dev/null
+check "siblings meet at the root" "$(curl -s http://localhost:8080/api/events/21/common_ancestors/22)" '[{"id":20,'
+bases=$(curl -s http://localhost:8080/api/events/23/common_ancestors/26)
+check "criss-cross has the left base" "$bases" '"id":21,'
+check "criss-cross has the right base" "$bases" '"id":22,'
+if [[ "$bases" == *'"id":20,'* ]]; then
+    echo "   FAIL: returned an ancestor of another merge base"
+    FAILED=1
+fi
+check "an ancestor is its own merge base" "$(curl -s http://localhost:8080/api/events/25/common_ancestors/21)" \
+    '[{"id":21,"data":"Left","parent_count":1,"parents":[20]}]'
+check "unrelated events" "$(curl -s http://localhost:8080/api/events/1/common_ancestors/20)" '[]'
+check "unknown event" "$(curl -s -o /dev/null -w '%{http_code}' http://localhost:8080/api/events/20/common_ancestors/99)" "404"
+echo
+
+# Test 13: A batch POST inserts all of its events or none of them
+echo "13. Testing batch POST..."
+post_batch() {
+    curl -s -o /dev/null -w '%{http_code}' -X POST http://localhost:8080/api/events \
+        -H "Content-Type: application/json" -d "$1"
+}
+check "existing id rejects the batch" \
+    "$(post_batch '[{"id": 30, "data": "New"}, {"id": 20, "data": "Taken"}]')" "409"
+check "repeated id rejects the batch" \
+    "$(post_batch '[{"id": 31, "data": "Once"}, {"id": 31, "data": "Twice"}]')" "409"
+check "malformed event rejects the batch" \
+    "$(post_batch '[{"id": 32, "data": "Fine"}, {"id": 33, "data": "bad \u12"}]')" "400"
+for id in 30 31 32; do
+    check "event $id not inserted" "$(curl -s -o /dev/null -w '%{http_code}' http://localhost:8080/api/events/$id)" "404"
+done
+check "valid batch inserted" "$(curl -s -X POST http://localhost:8080/api/events -H "Content-Type: application/json" \
+    -d '[{"id": 30, "data": "caf\u00e9"}, {"id": 31, "data": "\ud83d\ude00", "parents": [30]}]')" "2 events created"
+check "escapes stored as UTF-8" "$(curl -s http://localhost:8080/api/events/30)" '"data":"café"'
+check "surrogate pair stored as UTF-8" "$(curl -s http://localhost:8080/api/events/31)" '"data":"😀"'
+echo
+
+# Test 14: The binary and columnar exports decode to the same events as
+# the JSON listing; event 40 repeats a payload and spills parents
+echo "14. Testing format=binary and format=columnar..."
+curl -s -X POST http://localhost:8080/api/events -H "Content-Type: application/json" \
+  -d '{"id": 40, "data": "Root", "parents": [20, 21, 22, 23, 24]}' > /dev/null
+decoded=$(python3 - <<'PYTHON'
+import json, struct, urllib.request
+
+def crc32c(data):
+    crc = 0xFFFFFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ (0x82F63B78 if crc & 1 else 0)
+    return crc ^ 0xFFFFFFFF
+
+def fetch(query):
+    return urllib.request.urlopen("http://localhost:8080/api/events" + query).read()
+
+def event(event_id, data, parents):
+    return {"id": event_id, "data": data.decode(), "parent_count": len(parents), "parents": parents}
+
+def decode_binary(body):
+    assert body[:8] == b"CAUSALEX" and crc32c(body[:60]) == struct.unpack("<I", body[60:64])[0]
+    events, pos, count = [], 64, None
+    while count != 0:
+        length, _, _, count, _ = struct.unpack("<IIIII", body[pos:pos + 20])
+        records, heap = body[pos + 20:pos + 20 + 32 * count], body[pos + 20 + 32 * count:pos + length]
+        for r in range(count):
+            event_id, parent_count, data_length, offset, p0, p1 = struct.unpack("<IHHQII", records[32 * r:32 * r + 24])
+            more = max(parent_count - 2, 0)
+            parents = [p0, p1][:parent_count] + list(struct.unpack("<%dI" % more, heap[offset:offset + 4 * more]))
+            events.append(event(event_id, heap[offset + 4 * more:offset + 4 * more + data_length], parents))
+        pos += length
+    assert pos == len(body)
+    return events
+
+def varint(body, pos):
+    value, shift = 0, 0
+    while True:
+        value |= (body[pos] & 0x7F) << shift
+        shift += 7
+        pos += 1
+        if body[pos - 1] < 0x80:
+            return value, pos
+
+def decode_columnar(body):
+    assert body[:8] == b"CAUSALCO" and crc32c(body[:124]) == struct.unpack("<I", body[124:128])[0]
+    _, n, d = struct.unpack("<III", body[8:20])
+    sections = [struct.unpack("<QQ", body[24 + 16 * i:40 + 16 * i])[0] for i in range(6)]
+    assert all(offset % 8 == 0 for offset in sections)
+    ids = struct.unpack("<%dI" % n, body[sections[0]:sections[0] + 4 * n])
+    edge_offsets = struct.unpack("<%dQ" % (n + 1), body[sections[1]:sections[1] + 8 * (n + 1)])
+    codes = struct.unpack("<%dI" % n, body[sections[3]:sections[3] + 4 * n])
+    dict_offsets = struct.unpack("<%dQ" % (d + 1), body[sections[4]:sections[4] + 8 * (d + 1)])
+    events = []
+    for r in range(n):
+        count, pos = varint(body, sections[2] + edge_offsets[r])
+        parents, previous = [], ids[r]
+        for _ in range(count):
+            zigzag, pos = varint(body, pos)
+            previous = (previous + ((zigzag >> 1) ^ -(zigzag & 1))) & 0xFFFFFFFF
+            parents.append(previous)
+        assert pos == sections[2] + edge_offsets[r + 1]
+        data = body[sections[5] + dict_offsets[codes[r]]:sections[5] + dict_offsets[codes[r] + 1] - 1]
+        events.append(event(ids[r], data, parents))
+    return events, d
+
+listing = json.loads(fetch(""))
+print("binary", "matches" if decode_binary(fetch("?format=binary")) == listing else "differs")
+print("filtered", "matches" if decode_binary(fetch("?format=binary&q=Wire")) == json.loads(fetch("?q=Wire")) else "differs")
+columnar, payloads = decode_columnar(fetch("?format=columnar"))
+print("columnar", "matches" if columnar == listing else "differs")
+print("payloads", "deduplicated" if payloads == len({e["data"] for e in listing}) else "repeated")
+PYTHON
+)
+check "binary export" "$decoded" "binary matches"
+check "filtered binary export" "$decoded" "filtered matches"
+check "columnar export" "$decoded" "columnar matches"
+check "columnar dictionary" "$decoded" "payloads deduplicated"
+check "unknown format" "$(curl -s -o /dev/null -w '%{http_code}' 'http://localhost:8080/api/events?format=xml')" "400"
+echo
+
+if [ $FAILED -eq 0 ]; then
+    echo "API tests completed!"
+else
+    echo "API tests FAILED"
+fi
+exit $FAILED 
\ No newline at end of file
@@ -0,0 +1,204 @@
+#!/bin/bash
+
+# Runs the CLI against a scratch database. Build it first with `make`.
+
+CAUSALDB="$(cd "$(dirname "$0")/.." && pwd)/build/causaldb"
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+
+echo "Testing the CausalDB CLI..."
+
+FAILED=0
+
+# Reports whether "$2" contains "$3".
+check() {
+    if [[ "$2" == *"$3"* ]]; then
+        echo "   PASS: $1"
+    else
+        echo "   FAIL: $1 (got: ${2:0:200})"
+        FAILED=1
+    fi
+}
+
+# Starts the CLI, runs each argument as a command, exits and prints the
+# output.
+repl() {
+    printf '%s\n' "$@" .exit | "$CAUSALDB"
+}
+
+# Test 1: Inserts survive a restart in every durability mode
+echo "1. Testing .durability..."
+out=$(repl '.durability full' 'insert 1 "Full"' '.durability none' 'insert 2 "None" 1' \
+    '.durability group' 'insert 3 "Group" 2' '.durability sometimes')
+check "unknown mode refused" "$out" "Unknown durability mode"
+out=$(repl '.list')
+check "all inserts reloaded" "$out" "Loaded 3 events"
+check "full insert kept" "$out" "1: Full"
+check "none insert kept" "$out" "2: None"
+check "group insert kept" "$out" "3: Group"
+echo
+
+# Test 2: A partially written record or heap entry at the end of the log
+# is discarded on load, and later inserts append after the good rows
+echo "2. Testing recovery from an interrupted write..."
+printf 'torn' >> causal.cdb
+printf 'partial' >> causal.cdb.heap
+out=$(repl 'get 3')
+check "torn tail reported" "$out" "Recovered from an interrupted write (11 bytes discarded)"
+check "rows before it kept" "$out" "3: Group"
+check "data file truncated" "$(wc -c < causal.cdb)" "160"
+repl 'insert 4 "Cut short" 3' > /dev/null
+truncate -s -4 causal.cdb.heap
+out=$(repl 'get 4' 'insert 4 "Written again" 3')
+check "record with a cut payload dropped" "$out" "Event not found."
+out=$(repl 'get 4' '.list')
+check "rewritten event reloaded" "$out" "Loaded 4 events"
+check "rewritten event readable" "$out" "4: Written again"
+if [[ "$out" == *"Recovered"* ]]; then
+    echo "   FAIL: the rewrite left a torn tail"
+    FAILED=1
+fi
+echo
+
+# Test 3: .import loads JSONL and CSV, skips ids that already exist and
+# counts lines it cannot parse
+echo "3. Testing .import..."
+cat > events.jsonl <<'EOF'
+{"id": 10, "data": "caf\u00e9", "parents": []}
+{"id": 11, "data": "\ud83d\ude00 grin", "parents": [10]}
+{"id": 12, "data": "lone \ud800 surrogate", "parents": [10]}
+{"id": 13, "data": "short \u12"}
+{"id": 14, "data": "tab\there \"quoted\"", "parent_count": 2, "parents": [10, 11], "tags": {"a": [1, "]"]}}
+{"id": 15, "data": "naïve", "parents": [14]}
+{"id": 1, "data": "Already there"}
+{"id": 10, "data": "Repeated"}
+EOF
+cat > events.csv <<'EOF'
+id,data,parents
+20,Plain,
+21,"With ""quotes"", and a comma",20
+22,naïve,20 21
+1,Already there
+not a row
+EOF
+out=$(repl '.import events.jsonl' '.import events.csv' '.import missing.csv')
+check "JSONL counts" "$out" "Imported 5 events (2 already existed, 1 invalid)."
+check "CSV counts" "$out" "Imported 3 events (1 already existed, 1 invalid)."
+check "missing file" "$out" "Could not read missing.csv"
+out=$(repl 'get 10' 'get 11' 'get 12' 'get 14' 'get 15' 'get 1' 'get 21' 'get 22')
+check "imports reloaded" "$out" "Loaded 12 events"
+check "\\u escape decoded to UTF-8" "$out" "10: café"
+check "surrogate pair combined" "$out" "11: 😀 grin"
+check "unpaired surrogate replaced" "$out" $'12: lone \xef\xbf\xbd surrogate'
+check "other escapes decoded" "$out" $'14: tab\there "quoted"\n ⬑ Parents: 10 11'
+check "raw UTF-8 kept" "$out" "15: naïve"
+check "existing event untouched" "$out" "1: Full"
+check "quoted CSV field" "$out" '21: With "quotes", and a comma'
+check "CSV parents" "$out" $'22: naïve\n ⬑ Parents: 20 21'
+echo
+
+# Test 4: A record that fails its checksum is skipped on load
+echo "4. Testing record checksums..."
+printf 'X' | dd of=causal.cdb bs=1 seek=$((64 + 32 + 20)) conv=notrunc 2> /dev/null
+out=$(repl 'get 1' 'get 2' 'get 3')
+check "corrupt record reported" "$out" "Warning: skipped 1 corrupt events (checksum mismatch)."
+check "corrupt record skipped" "$out" $'db > Event not found.\ndb > 3: Group'
+check "other records kept" "$out" "1: Full"
+echo
+
+# Test 5: build/migrate converts each older format, dropping rows that
+# fail their checksum
+echo "5. Testing migrate..."
+MIGRATE="$(dirname "$CAUSALDB")/migrate"
+for version in 0 1 2; do
+    mkdir -p "v$version" && cd "v$version" || exit 1
+    # Writes causal.cdb (and causal.cdb.heap for version 2) in the given
+    # format: event 1, event 2 with a corrupted checksum (ignored by
+    # version 0, which has none) and event 3 with three parents.
+    python3 - "$version" <<'PYTHON'
+import struct, sys
+
+def crc32c(data):
+    crc = 0xFFFFFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ (0x82F63B78 if crc & 1 else 0)
+    return crc ^ 0xFFFFFFFF
+
+version = int(sys.argv[1])
+events = [(1, [], b"Old root"), (2, [1], b"Old child"), (3, [1, 2, 1], "Old café".encode())]
+rows = heap = b""
+if version > 0:
+    header = b"CAUSALDB" + struct.pack("<II", version, 192 if version == 1 else 64).ljust(52, b"\0")
+    rows = header + struct.pack("<I", crc32c(header))
+for event_id, parents, data in events:
+    packed = struct.pack("<8I", *(parents + [0] * 8)[:8])
+    if version == 0:
+        row = struct.pack("<IB", event_id, len(parents)) + packed + data.ljust(131, b"\0")
+    elif version == 1:
+        row = struct.pack("<IB3x", event_id, len(parents)) + packed + data.ljust(148, b"\0")
+    else:
+        row = struct.pack("<IB3x", event_id, len(parents)) + packed + \
+            struct.pack("<QII4x", len(heap), len(data), crc32c(data))
+        heap += data + b"\0"
+    if version > 0:
+        row += struct.pack("<I", crc32c(row))
+        if event_id == 2:
+            row = row[:20] + b"X" + row[21:]  # No longer matches its checksum
+    rows += row
+open("causal.cdb", "wb").write(rows)
+if version == 2:
+    open("causal.cdb.heap", "wb").write(heap)
+PYTHON
+    out=$("$MIGRATE" causal.cdb)
+    if [ "$version" -eq 0 ]; then
+        check "version 0 migrated" "$out" "Migrated 3 events in causal.cdb from format version 0"
+    else
+        check "version $version migrated" "$out" "Migrated 2 events in causal.cdb from format version $version"
+        check "version $version corrupt row dropped" "$out" "Dropped 1 rows that failed their checksum."
+    fi
+    check "version $version original kept" "$(ls)" "causal.cdb.bak"
+    check "version $version already current" "$("$MIGRATE" causal.cdb)" "already in format version"
+    out=$(repl 'get 1' 'get 3')
+    check "version $version loads" "$out" "1: Old root"
+    check "version $version parents and data" "$out" $'3: Old café\n ⬑ Parents: 1 2 1'
+    cd .. || exit 1
+done
+echo
+
+# Test 6: The saved text index is reloaded, extended with rows added
+# after it was saved, and rebuilt if it no longer matches the data
+echo "6. Testing the saved text index..."
+mkdir -p fts other && cd fts || exit 1
+repl 'insert 1 "apple banana"' 'insert 2 "banana cherry" 1' > /dev/null
+cp causal.cdb.fts two_rows.fts
+check "reloaded index answers" "$(repl 'search "banana"')" $'1: apple banana\n ⬑ Parents:\n2: banana cherry'
+repl 'insert 3 "cherry date" 2' > /dev/null
+cp causal.cdb.fts three_rows.fts
+cp two_rows.fts causal.cdb.fts
+out=$(repl 'search "cherry"')
+check "rows added since the save indexed" "$out" $'2: banana cherry\n ⬑ Parents: 1\n3: cherry date'
+if cmp -s causal.cdb.fts two_rows.fts; then
+    echo "   FAIL: the saved index was not brought up to date"
+    FAILED=1
+fi
+cd ../other || exit 1
+repl 'insert 1 "apple banana"' 'insert 2 "grape"' > /dev/null
+cp ../fts/two_rows.fts causal.cdb.fts
+out=$(repl 'search "cherry"' 'search "grape"')
+check "index of different data rebuilt" "$out" $'db > No matching events.\ndb > 2: grape'
+cp ../fts/three_rows.fts causal.cdb.fts
+check "index of more rows rebuilt" "$(repl 'search "date"')" "No matching events."
+printf 'not an index' > causal.cdb.fts
+check "damaged index rebuilt" "$(repl 'search "apple"')" "1: apple banana"
+cd .. || exit 1
+echo
+
+if [ $FAILED -eq 0 ]; then
+    echo "CLI tests completed!"
+else
+    echo "CLI tests FAILED"
+fi
+exit $FAILED
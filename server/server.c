@@ -1,27 +1,211 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // SO_REUSEPORT
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <dirent.h>
+#include <time.h>
+#include <zlib.h>
 #include "../include/event.h"
 #include "../include/db.h"
 #include "../include/statement.h"
+#include "../include/graph.h"
+#include "../include/import.h"
+#include "../include/scan.h"
+#include "../include/snapshot.h"
+#include "../include/wire.h"
+#include "../include/export.h"
 
 #define PORT 8080
-#define BUFFER_SIZE 16384  // Increased from 4096 to 16KB
-#define MAX_CLIENTS 10
+#define WIRE_PORT 8081 // Binary protocol, see wire.h
+#define BUFFER_SIZE 65536  // Room for one event with the maximum data and parents
+#define LISTEN_BACKLOG 1024
+#define MAX_HEADER_SIZE 8192
+#define MAX_PATH_LENGTH 2048
+#define MAX_BODY_SIZE (64 * 1024 * 1024) // Room for large ingest batches
+#define MAX_WAIT_EVENTS 64
+#define READ_CHUNK 16384
+#define EVENT_JSON_SIZE (6 * MAX_DATA_LENGTH + 11 * MAX_PARENTS + 256) // Data fully \u-escaped
+#define STREAM_CHUNK_SIZE (32 * 1024)
+#define COLUMNAR_BLOCK_ROWS 16384 // Rows added to a columnar export per snapshot held
+#define CHUNK_HEADER_SIZE 10 // "%08zx\r\n"
+#define STREAMED_LENGTH ((size_t)-1) // Body of unknown length, sent as it is produced
+#define FRONTEND_DIR "../frontend"
+#define MAX_ASSETS 64
+#define TAIL_BATCH_EVENTS 512
+#define TAIL_HIGH_WATER (256 * 1024) // Queued bytes at which a subscriber is left to catch up
 
+// The database, loaded once at startup. Queries read a snapshot of it
+// and never wait for inserts.
+SnapshotStore store;
+
+// A frontend file, opened once at startup. The plain body is sent straight
+// from the file with sendfile(); the gzip variant, kept only if it is
+// smaller, is compressed up front and sent from memory. Files changed on
+// disk are picked up on restart.
 typedef struct {
-    char method[10];
-    char path[256];
-    char content_type[64];
-    int content_length;
-    char body[BUFFER_SIZE];
+    char path[260]; // URL path, e.g. "/script.js"
+    const char* content_type;
+    int fd;
+    size_t size;
+    char etag[48];
+    char gzip_etag[48];
+    char last_modified[40];
+    char* gzip;
+    size_t gzip_size;
+} Asset;
+
+Asset assets[MAX_ASSETS];
+size_t num_assets;
+
+// A list of events being sent a chunk at a time: GET /api/events, or the
+// result rows of a traversal or search. The former covers the rows
+// published when the request arrived, so a long export sees one consistent
+// prefix of the table even though each chunk reads whatever snapshot is
+// current; rows keep their numbers in every later snapshot.
+typedef struct {
+    int active;
+    int binary;          // Binary export frames (export.h) instead of a JSON array
+    int chunked;         // Transfer-Encoding: chunked, else ends with the connection.
+                         // Also used for the event feed, see start_event_feed().
+    int started;         // The opening bracket has been sent
+    uint32_t* rows;      // If set, the rows to send: rows[next_row] up to rows[end_row]
+    ColumnarExport* columnar; // If set, the ?format=columnar export being built instead
+    uint32_t next_row;
+    uint32_t end_row;
+    size_t skip;         // Matching events still to pass over (?offset=)
+    size_t remaining;    // Events still to send (?limit=)
+    size_t sent;
+    char query[MAX_PATH_LENGTH + 1]; // ?q= substring filter, as long as any path
+    int query_length;
+} EventStream;
+
+typedef enum {
+    PARSE_REQUEST_LINE,
+    PARSE_HEADERS,
+    PARSE_BODY,
+    PARSE_DONE,
+    PARSE_FAILED
+} ParseState;
+
+// Incremental parser for the request at the front of a connection's
+// input. It resumes where it stopped whenever more arrives, so a request
+// split across any number of reads is only scanned once. Fields are
+// NUL-terminated in place and kept as offsets into the input, which may
+// move as it grows; 0 marks an absent header, as offset 0 always belongs
+// to the request line.
+typedef struct {
+    ParseState state;
+    int error_status;     // Why parsing failed: 400, 413, 414, 431 or 501
+    size_t scanned;       // Input examined so far
+    size_t method;
+    size_t path;
+    size_t content_type;
+    size_t if_none_match;
+    size_t if_modified_since;
+    size_t last_event_id;
+    size_t body;
+    size_t content_length;
+    int has_content_length;
+    int http11;
+    int keep_alive;
+    int accepts_gzip;
+} RequestParser;
+
+// One client connection, owned by a single worker. Requests are read into
+// `in` and may arrive several at once (pipelining); their responses are
+// queued in `out` in the same order and written as the socket accepts
+// them.
+typedef struct {
+    int fd;
+    char* in;
+    size_t in_len;
+    size_t in_cap;
+    char* out;
+    size_t out_len;
+    size_t out_sent;
+    size_t out_cap;
+    int close_after; // Close once `out` has been sent
+    int peer_closed; // The client has finished sending
+    int want_write;  // Registered for EPOLLOUT
+    unsigned reader_slot; // Owning worker's index in `workers`, and its snapshot_acquire() slot
+    RequestParser parser; // For the first request in `in`
+    EventStream stream;   // Requests after it wait until it is done
+    int file_fd;          // Body to send with sendfile() once `out` is empty
+    off_t file_offset;
+    size_t file_remaining; // Requests after it wait until this reaches 0
+    int file_owned;       // `file_fd` is closed once sent, rather than a cached asset
+    int binary;           // Speaks the wire protocol instead of HTTP
+    int subscribed;       // Tailing new events from `tail_row`, as wire frames or
+                          // server-sent events; nothing else is read after that
+    uint32_t tail_row;
+    uint32_t tail_tag;    // Tag of the WIRE_SUBSCRIBE frame, echoed in WIRE_EVENTS
+    struct PendingWrite* write; // Insert with the writer; requests after it wait
+} Connection;
+
+// An insert handed to the writer thread. Its events point into the request
+// body or frame where it was read, and the connection's input buffer goes
+// with them (see hand_over_input()). The writer passes it back through the
+// owning worker's `finished` list, and that worker sends the reply.
+typedef struct PendingWrite {
+    SnapshotWrite write; // First, so the writer can get from one to the other
+    Connection* conn;    // NULL once the connection has been closed
+    unsigned worker;
+    char* input;         // The connection's former input buffer
+    BlobHeap overflow;
+    int is_array;        // The HTTP body was an array
+    uint32_t tag;        // Of the WIRE_INSERT frame
+    struct PendingWrite* next_finished;
+} PendingWrite;
+
+// A worker runs one epoll loop over its own listening sockets; the kernel
+// spreads incoming connections across the listeners via SO_REUSEPORT.
+// Subscribers are tailed by the worker that accepted them, which is woken
+// through `notify_fd` whenever events are inserted, and so is the worker
+// whose connection's insert the writer has finished.
+typedef struct {
+    int listen_fd;
+    int wire_fd;
+    int notify_fd; // eventfd
+    int epoll_fd;
+    unsigned number;
+    pthread_t thread;
+    Connection** subscribers;
+    size_t num_subscribers; // Read by inserting threads
+    size_t subscribers_cap;
+    pthread_mutex_t finished_lock;
+    PendingWrite* finished; // Inserts done by the writer, for this worker's connections
+} Worker;
+
+Worker* workers;
+long num_workers;
+
+typedef struct {
+    // Point into the connection's input, valid while the request is handled
+    char* method;
+    char* path;
+    const char* content_type;
+    const char* if_none_match;     // "" if absent
+    const char* if_modified_since; // "" if absent
+    const char* last_event_id;     // NULL if absent
+    char* body;                    // NUL-terminated
+    size_t content_length;
+    int keep_alive;
+    int http11;
+    int accepts_gzip;
 } HTTPRequest;
 
 typedef struct {
@@ -32,321 +216,1058 @@ typedef struct {
     int body_length;
 } HTTPResponse;
 
-void parse_http_request(char* buffer, HTTPRequest* req) {
-    char* line = strtok(buffer, "\n");
-    if (line) {
-        sscanf(line, "%s %s", req->method, req->path);
+void parse_failed(RequestParser* parser, int status) {
+    parser->state = PARSE_FAILED;
+    parser->error_status = status;
+}
+
+// Splits "METHOD /path HTTP/1.x", which starts at offset `start`.
+void parse_request_line(RequestParser* parser, char* in, size_t start) {
+    char* method = in + start;
+    char* path = strchr(method, ' ');
+    char* version = path ? strchr(path + 1, ' ') : NULL;
+    if (!version || path == method || version == path + 1 || strncmp(version + 1, "HTTP/", 5) != 0) {
+        parse_failed(parser, 400);
+        return;
     }
-    
-    // Default content type
-    strcpy(req->content_type, "text/plain");
-    req->content_length = 0;
-    req->body[0] = '\0';
-    
-    // Parse headers
-    while ((line = strtok(NULL, "\n")) != NULL) {
-        if (strncmp(line, "Content-Type:", 13) == 0) {
-            sscanf(line, "Content-Type: %s", req->content_type);
-        } else if (strncmp(line, "Content-Length:", 15) == 0) {
-            sscanf(line, "Content-Length: %d", &req->content_length);
+    if (version - path - 1 > MAX_PATH_LENGTH) {
+        parse_failed(parser, 414);
+        return;
+    }
+    *path++ = '\0';
+    *version++ = '\0';
+    parser->method = start;
+    parser->path = (size_t)(path - in);
+    // HTTP/1.1 connections stay open unless the client says otherwise
+    parser->http11 = strcmp(version, "HTTP/1.1") == 0;
+    parser->keep_alive = parser->http11;
+    parser->state = PARSE_HEADERS;
+}
+
+// Handles the header line at offset `start`.
+void parse_header(RequestParser* parser, char* in, size_t start) {
+    char* name = in + start;
+    char* value = strchr(name, ':');
+    if (!value || value == name) {
+        parse_failed(parser, 400);
+        return;
+    }
+    size_t name_len = (size_t)(value - name);
+    value++;
+    while (*value == ' ' || *value == '\t') value++;
+    char* end = value + strlen(value);
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+    size_t offset = (size_t)(value - in);
+
+    if (name_len == 14 && strncasecmp(name, "Content-Length", 14) == 0) {
+        char* digits_end;
+        unsigned long long length = strtoull(value, &digits_end, 10);
+        if (*value < '0' || *value > '9' || *digits_end != '\0' ||
+            (parser->has_content_length && length != parser->content_length)) {
+            parse_failed(parser, 400);
+        } else if (length > MAX_BODY_SIZE) {
+            parse_failed(parser, 413);
+        } else {
+            parser->content_length = (size_t)length;
+            parser->has_content_length = 1;
         }
-        if (strcmp(line, "\r") == 0 || strlen(line) == 0) break;
+    } else if (name_len == 17 && strncasecmp(name, "Transfer-Encoding", 17) == 0) {
+        // Chunked uploads are not supported; senders must give a length
+        parse_failed(parser, 501);
+    } else if (name_len == 10 && strncasecmp(name, "Connection", 10) == 0) {
+        if (strstr(value, "close")) parser->keep_alive = 0;
+        if (strstr(value, "keep-alive")) parser->keep_alive = 1;
+    } else if (name_len == 12 && strncasecmp(name, "Content-Type", 12) == 0) {
+        parser->content_type = offset;
+    } else if (name_len == 15 && strncasecmp(name, "Accept-Encoding", 15) == 0) {
+        parser->accepts_gzip = strstr(value, "gzip") != NULL;
+    } else if (name_len == 13 && strncasecmp(name, "If-None-Match", 13) == 0) {
+        parser->if_none_match = offset;
+    } else if (name_len == 17 && strncasecmp(name, "If-Modified-Since", 17) == 0) {
+        parser->if_modified_since = offset;
+    } else if (name_len == 13 && strncasecmp(name, "Last-Event-ID", 13) == 0) {
+        parser->last_event_id = offset;
     }
-    
-    // Extract body if present
-    char* body_start = strstr(buffer, "\r\n\r\n");
-    if (body_start && req->content_length > 0) {
-        body_start += 4; // Skip \r\n\r\n
-        strncpy(req->body, body_start, req->content_length);
-        req->body[req->content_length] = '\0';
+}
+
+// Advances `parser` over the `len` bytes of `in`, which start with the
+// bytes it has already seen, and returns how far it got.
+ParseState parse_request(RequestParser* parser, char* in, size_t len) {
+    while (parser->state == PARSE_REQUEST_LINE || parser->state == PARSE_HEADERS) {
+        char* newline = memchr(in + parser->scanned, '\n', len - parser->scanned);
+        if (!newline) {
+            if (len >= MAX_HEADER_SIZE) parse_failed(parser, 431);
+            break;
+        }
+        size_t start = parser->scanned;
+        size_t end = (size_t)(newline - in);
+        parser->scanned = end + 1;
+        if (parser->scanned > MAX_HEADER_SIZE) {
+            parse_failed(parser, 431);
+            break;
+        }
+        if (end > start && in[end - 1] == '\r') end--;
+        in[end] = '\0';
+
+        if (parser->state == PARSE_REQUEST_LINE) {
+            // Stray line breaks between requests are skipped
+            if (end > start) parse_request_line(parser, in, start);
+        } else if (end == start) {
+            parser->body = parser->scanned;
+            parser->state = PARSE_BODY;
+        } else {
+            parse_header(parser, in, start);
+        }
+    }
+    if (parser->state == PARSE_BODY && len - parser->body >= parser->content_length) {
+        parser->state = PARSE_DONE;
     }
+    return parser->state;
 }
 
-void send_http_response(int client_socket, HTTPResponse* resp) {
-    char response[BUFFER_SIZE];
-    int len = snprintf(response, BUFFER_SIZE,
+// Returns room for `length` more bytes at the end of the output queue;
+// the caller fills it and adds what it used to `out_len`. On failure the
+// connection is closed once what is already queued has gone out.
+char* conn_reserve(Connection* conn, size_t length) {
+    if (conn->out_sent == conn->out_len) {
+        conn->out_sent = 0;
+        conn->out_len = 0;
+    }
+    if (conn->out_len + length > conn->out_cap) {
+        size_t capacity = conn->out_cap ? conn->out_cap : READ_CHUNK;
+        while (capacity < conn->out_len + length) capacity *= 2;
+        char* grown = realloc(conn->out, capacity);
+        if (!grown) {
+            conn->close_after = 1;
+            return NULL;
+        }
+        conn->out = grown;
+        conn->out_cap = capacity;
+    }
+    return conn->out + conn->out_len;
+}
+
+// Queues `length` bytes for sending.
+int conn_write(Connection* conn, const void* data, size_t length) {
+    char* dest = conn_reserve(conn, length);
+    if (!dest) return 0;
+    memcpy(dest, data, length);
+    conn->out_len += length;
+    return 1;
+}
+
+// A `content_length` of STREAMED_LENGTH announces a chunked body if the
+// stream is chunked, and otherwise one that ends when the connection does.
+// `extra` holds any further header lines, each ending in \r\n, or is NULL.
+void send_response_headers(Connection* conn, int status_code, const char* status_text,
+                           const char* content_type, size_t content_length, const char* extra) {
+    char length_header[64] = "";
+    if (content_length != STREAMED_LENGTH) {
+        snprintf(length_header, sizeof(length_header), "Content-Length: %zu\r\n", content_length);
+    } else if (conn->stream.chunked) {
+        strcpy(length_header, "Transfer-Encoding: chunked\r\n");
+    }
+
+    char headers[1024];
+    int len = snprintf(headers, sizeof(headers),
         "HTTP/1.1 %d %s\r\n"
         "Content-Type: %s\r\n"
         "Access-Control-Allow-Origin: *\r\n"
         "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
         "Access-Control-Allow-Headers: Content-Type\r\n"
-        "Content-Length: %d\r\n"
-        "\r\n"
-        "%s",
-        resp->status_code, resp->status_text,
-        resp->content_type,
-        resp->body_length,
-        resp->body);
-    
-    send(client_socket, response, len, 0);
+        "%s%s"
+        "Connection: %s\r\n"
+        "\r\n",
+        status_code, status_text, content_type, length_header, extra ? extra : "",
+        conn->close_after ? "close" : "keep-alive");
+    conn_write(conn, headers, (size_t)len);
 }
 
-void send_json_response(int client_socket, int status_code, const char* json_data) {
-    HTTPResponse resp;
-    resp.status_code = status_code;
-    strcpy(resp.status_text, status_code == 200 ? "OK" : "Not Found");
-    strcpy(resp.content_type, "application/json");
-    strcpy(resp.body, json_data);
-    resp.body_length = strlen(json_data);
-    
-    send_http_response(client_socket, &resp);
+void send_http_response(Connection* conn, HTTPResponse* resp) {
+    send_response_headers(conn, resp->status_code, resp->status_text, resp->content_type,
+                          (size_t)resp->body_length, NULL);
+    conn_write(conn, resp->body, (size_t)resp->body_length);
+}
+
+const char* get_status_text(int status_code) {
+    switch (status_code) {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 409: return "Conflict";
+        case 413: return "Payload Too Large";
+        case 414: return "URI Too Long";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        default: return "Unknown";
+    }
+}
+
+void send_json_response(Connection* conn, int status_code, const char* json_data) {
+    size_t length = strlen(json_data);
+    send_response_headers(conn, status_code, get_status_text(status_code), "application/json", length, NULL);
+    conn_write(conn, json_data, length);
+}
+
+char* get_content_type(const char* path) {
+    if (strcmp(path, "/") == 0 || strstr(path, ".html")) return "text/html";
+    if (strstr(path, ".css")) return "text/css";
+    if (strstr(path, ".js")) return "application/javascript";
+    if (strstr(path, ".json")) return "application/json";
+    return "text/plain";
+}
+
+// Compresses `data` into a gzip stream. Returns NULL if that fails.
+char* gzip_compress(const char* data, size_t size, size_t* out_size) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // 15 window bits, plus 16 for a gzip header instead of a zlib one
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    size_t capacity = deflateBound(&zs, (uLong)size);
+    char* out = malloc(capacity);
+    zs.next_in = (Bytef*)data;
+    zs.avail_in = (uInt)size;
+    zs.next_out = (Bytef*)out;
+    zs.avail_out = (uInt)capacity;
+    int done = out && deflate(&zs, Z_FINISH) == Z_STREAM_END;
+    *out_size = zs.total_out;
+    deflateEnd(&zs);
+    if (!done) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+// Opens the file behind `asset` and prepares its validators and gzip
+// variant. Returns 0 if the file cannot be served.
+int load_asset(Asset* asset, const char* file_path) {
+    asset->fd = open(file_path, O_RDONLY);
+    struct stat st;
+    if (asset->fd < 0 || fstat(asset->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (asset->fd >= 0) close(asset->fd);
+        return 0;
+    }
+    asset->size = (size_t)st.st_size;
+    asset->content_type = get_content_type(asset->path);
+    snprintf(asset->etag, sizeof(asset->etag), "\"%zx-%lx\"", asset->size, (unsigned long)st.st_mtime);
+    snprintf(asset->gzip_etag, sizeof(asset->gzip_etag), "\"%zx-%lx-gz\"", asset->size,
+             (unsigned long)st.st_mtime);
+    struct tm modified;
+    gmtime_r(&st.st_mtime, &modified);
+    strftime(asset->last_modified, sizeof(asset->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &modified);
+
+    asset->gzip = NULL;
+    asset->gzip_size = 0;
+    char* content = malloc(asset->size ? asset->size : 1);
+    if (content && pread(asset->fd, content, asset->size, 0) == (ssize_t)asset->size) {
+        asset->gzip = gzip_compress(content, asset->size, &asset->gzip_size);
+        if (asset->gzip && asset->gzip_size >= asset->size) {
+            free(asset->gzip);
+            asset->gzip = NULL;
+        }
+    }
+    free(content);
+    return 1;
+}
+
+// Loads every file in the frontend directory into the asset cache.
+void load_assets() {
+    DIR* dir = opendir(FRONTEND_DIR);
+    if (!dir) {
+        perror("Frontend directory");
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL && num_assets < MAX_ASSETS) {
+        if (entry->d_name[0] == '.') continue;
+        Asset* asset = &assets[num_assets];
+        char file_path[512];
+        snprintf(asset->path, sizeof(asset->path), "/%s", entry->d_name);
+        snprintf(file_path, sizeof(file_path), "%s/%s", FRONTEND_DIR, entry->d_name);
+        if (load_asset(asset, file_path)) num_assets++;
+    }
+    closedir(dir);
 }
 
-void send_file_response(int client_socket, const char* file_path, const char* content_type) {
-    FILE* file = fopen(file_path, "rb");
-    if (!file) {
+Asset* find_asset(const char* path) {
+    size_t len = strcspn(path, "?");
+    if (len == 1 && path[0] == '/') {
+        path = "/index.html";
+        len = strlen(path);
+    }
+    for (size_t i = 0; i < num_assets; i++) {
+        if (strlen(assets[i].path) == len && strncmp(assets[i].path, path, len) == 0) return &assets[i];
+    }
+    return NULL;
+}
+
+// Serves a cached frontend file, or 304 Not Modified if the client's copy
+// is still current.
+void send_asset_response(Connection* conn, HTTPRequest* req) {
+    Asset* asset = find_asset(req->path);
+    if (!asset) {
         HTTPResponse resp;
         resp.status_code = 404;
         strcpy(resp.status_text, "Not Found");
         strcpy(resp.content_type, "text/plain");
         strcpy(resp.body, "File not found");
         resp.body_length = strlen(resp.body);
-        send_http_response(client_socket, &resp);
+        send_http_response(conn, &resp);
         return;
     }
-    
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    if (file_size <= 0) {
-        fclose(file);
-        HTTPResponse resp;
-        resp.status_code = 500;
-        strcpy(resp.status_text, "Internal Server Error");
-        strcpy(resp.content_type, "text/plain");
-        strcpy(resp.body, "File is empty");
-        resp.body_length = strlen(resp.body);
-        send_http_response(client_socket, &resp);
+
+    int gzip = asset->gzip && req->accepts_gzip;
+    const char* etag = gzip ? asset->gzip_etag : asset->etag;
+    char extra[256];
+    snprintf(extra, sizeof(extra),
+        "ETag: %s\r\n"
+        "Last-Modified: %s\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Vary: Accept-Encoding\r\n"
+        "%s",
+        etag, asset->last_modified, gzip ? "Content-Encoding: gzip\r\n" : "");
+
+    // If-None-Match wins over If-Modified-Since when both are present
+    int not_modified = req->if_none_match[0]
+        ? strstr(req->if_none_match, etag) != NULL || strcmp(req->if_none_match, "*") == 0
+        : req->if_modified_since[0] && strcmp(req->if_modified_since, asset->last_modified) == 0;
+    if (not_modified) {
+        send_response_headers(conn, 304, "Not Modified", asset->content_type, 0, extra);
         return;
     }
-    
-    // For files that fit in buffer, send them directly
-    if (file_size <= BUFFER_SIZE - 1) {
-        char* file_content = malloc(file_size + 1);
-        if (!file_content) {
-            fclose(file);
-            HTTPResponse resp;
-            resp.status_code = 500;
-            strcpy(resp.status_text, "Internal Server Error");
-            strcpy(resp.content_type, "text/plain");
-            strcpy(resp.body, "Memory allocation failed");
-            resp.body_length = strlen(resp.body);
-            send_http_response(client_socket, &resp);
-            return;
+
+    size_t size = gzip ? asset->gzip_size : asset->size;
+    send_response_headers(conn, 200, "OK", asset->content_type, size, extra);
+    if (gzip) {
+        conn_write(conn, asset->gzip, size);
+    } else {
+        conn->file_fd = asset->fd;
+        conn->file_offset = 0;
+        conn->file_remaining = size;
+    }
+}
+
+// Writes `data` as the inside of a JSON string. `out` needs room for six
+// bytes per input byte. Returns the length written.
+size_t escape_json(char* out, const char* data, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    char* p = out;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)data[i];
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = (char)c;
+        } else if (c == '\n') {
+            *p++ = '\\';
+            *p++ = 'n';
+        } else if (c == '\r') {
+            *p++ = '\\';
+            *p++ = 'r';
+        } else if (c == '\t') {
+            *p++ = '\\';
+            *p++ = 't';
+        } else if (c < 0x20) {
+            memcpy(p, "\\u00", 4);
+            p[4] = hex[c >> 4];
+            p[5] = hex[c & 15];
+            p += 6;
+        } else {
+            *p++ = (char)c;
         }
-        
-        size_t bytes_read = fread(file_content, 1, file_size, file);
-        fclose(file);
-        
-        if (bytes_read != file_size) {
-            free(file_content);
-            HTTPResponse resp;
-            resp.status_code = 500;
-            strcpy(resp.status_text, "Internal Server Error");
-            strcpy(resp.content_type, "text/plain");
-            strcpy(resp.body, "Failed to read file");
-            resp.body_length = strlen(resp.body);
-            send_http_response(client_socket, &resp);
+    }
+    return (size_t)(p - out);
+}
+
+// Writes `event` as a JSON object to `out`, which must hold
+// EVENT_JSON_SIZE bytes, and returns its length without the terminator.
+size_t format_event_json(Event* event, char* out) {
+    size_t len = (size_t)sprintf(out, "{\"id\":%u,\"data\":\"", event->id);
+    len += escape_json(out + len, event->data, event->data_length);
+    len += (size_t)sprintf(out + len, "\",\"parent_count\":%u,\"parents\":[", event->parent_count);
+    for (uint32_t j = 0; j < event->parent_count; j++) {
+        len += (size_t)sprintf(out + len, j > 0 ? ",%u" : "%u", event_parent(event, j));
+    }
+    memcpy(out + len, "]}", 3);
+    return len + 2;
+}
+
+void handle_api_event_by_id(Connection* conn, Table* table, uint32_t id) {
+    Event event;
+    if (find_event_in_memory(id, table, &event)) {
+        char event_json[EVENT_JSON_SIZE];
+        format_event_json(&event, event_json);
+        send_json_response(conn, 200, event_json);
+    } else {
+        send_json_response(conn, 404, "{\"error\":\"Event not found\"}");
+    }
+}
+
+// Sends the headers of a streamed response set up in `conn->stream`;
+// continue_stream() produces the body.
+void begin_stream(Connection* conn, HTTPRequest* req, const char* extra) {
+    EventStream* stream = &conn->stream;
+    stream->sent = 0;
+    stream->started = 0;
+    // HTTP/1.0 clients get the body unframed and read it until we hang up
+    stream->chunked = req->http11;
+    if (!stream->chunked) conn->close_after = 1;
+    stream->active = 1;
+    send_response_headers(conn, 200, "OK", stream->binary ? "application/octet-stream" : "application/json",
+                          STREAMED_LENGTH, extra);
+}
+
+// Streams the events in `result` as a JSON array, taking over its rows.
+// A traversal cut short by its limit is flagged in a header, since the
+// body is under way before anything else could report it.
+void stream_rows(Connection* conn, HTTPRequest* req, Traversal* result) {
+    EventStream* stream = &conn->stream;
+    stream->rows = result->rows;
+    stream->next_row = 0;
+    stream->end_row = (uint32_t)result->count;
+    stream->binary = 0;
+    stream->query_length = 0;
+    stream->skip = 0;
+    stream->remaining = (size_t)-1;
+    begin_stream(conn, req, result->truncated ?
+                 "X-Truncated: true\r\nAccess-Control-Expose-Headers: X-Truncated\r\n" : NULL);
+    result->rows = NULL;
+    result->count = 0;
+}
+
+void end_stream(EventStream* stream) {
+    free(stream->rows);
+    stream->rows = NULL;
+    if (stream->columnar) columnar_free(stream->columnar);
+    free(stream->columnar);
+    stream->columnar = NULL;
+    stream->active = 0;
+}
+
+void handle_api_event_children(Connection* conn, HTTPRequest* req, Table* table, uint32_t id) {
+    const ChildList* list = child_index_list(&table->children, id);
+    if (!list && !lookup_row(id, table, NULL)) {
+        send_json_response(conn, 404, "{\"error\":\"Event not found\"}");
+        return;
+    }
+
+    Traversal result = {NULL, 0, 0};
+    size_t count = 0;
+    for (uint32_t edge = list ? list->head : EDGE_NONE; edge != EDGE_NONE; edge = table->children.edges[edge].next) {
+        count++;
+    }
+    if (count > 0) {
+        result.rows = malloc(count * sizeof(uint32_t));
+        if (!result.rows) {
+            send_json_response(conn, 500, "{\"error\":\"Out of memory\"}");
             return;
         }
-        
-        file_content[file_size] = '\0';
-        
-        HTTPResponse resp;
-        resp.status_code = 200;
-        strcpy(resp.status_text, "OK");
-        strcpy(resp.content_type, content_type);
-        strcpy(resp.body, file_content);
-        resp.body_length = file_size;
-        
-        send_http_response(client_socket, &resp);
-        free(file_content);
+        for (uint32_t edge = list->head; edge != EDGE_NONE; edge = table->children.edges[edge].next) {
+            result.rows[result.count++] = table->children.edges[edge].child_row;
+        }
+    }
+    stream_rows(conn, req, &result);
+}
+
+// Returns the raw value of query parameter `name` in `path`, or NULL if
+// it is absent.
+const char* find_query_param(const char* path, const char* name) {
+    const char* query = strchr(path, '?');
+    size_t name_len = strlen(name);
+    while (query) {
+        query++;
+        if (strncmp(query, name, name_len) == 0 && query[name_len] == '=') {
+            return query + name_len + 1;
+        }
+        query = strchr(query, '&');
+    }
+    return NULL;
+}
+
+// Returns the numeric value of query parameter `name` in `path`, or
+// `fallback` if it is absent.
+unsigned long get_query_param(const char* path, const char* name, unsigned long fallback) {
+    const char* value = find_query_param(path, name);
+    return value ? strtoul(value, NULL, 10) : fallback;
+}
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// URL-decodes query parameter `name` into `out`. Returns the decoded
+// length, or -1 if the parameter is absent.
+int get_query_string(const char* path, const char* name, char* out, size_t out_size) {
+    const char* value = find_query_param(path, name);
+    if (!value) return -1;
+    size_t len = 0;
+    while (*value && *value != '&' && len + 1 < out_size) {
+        if (*value == '%' && hex_value(value[1]) >= 0 && hex_value(value[2]) >= 0) {
+            out[len++] = (char)(hex_value(value[1]) * 16 + hex_value(value[2]));
+            value += 3;
+        } else {
+            out[len++] = *value == '+' ? ' ' : *value;
+            value++;
+        }
+    }
+    out[len] = '\0';
+    return (int)len;
+}
+
+// Matches a path segment, ignoring any query string that follows it.
+int path_matches(const char* path, const char* route) {
+    size_t len = strlen(route);
+    return strncmp(path, route, len) == 0 && (path[len] == '\0' || path[len] == '?');
+}
+
+void handle_api_event_traversal(Connection* conn, HTTPRequest* req, Table* table, uint32_t id, TraversalDirection direction) {
+    uint32_t depth = (uint32_t)get_query_param(req->path, "depth", 0);
+    size_t limit = get_query_param(req->path, "limit", 0);
+
+    Traversal result;
+    if (!traverse(table, id, direction, depth, limit, &result)) {
+        send_json_response(conn, 404, "{\"error\":\"Event not found\"}");
+        return;
+    }
+
+    stream_rows(conn, req, &result);
+}
+
+// Snapshots must not be modified, so an index the writer could not
+// rebuild for lack of memory fails the query instead of being rebuilt.
+int indexes_ready(Connection* conn, Table* table) {
+    if (!table->reach.stale && !table->text.stale) return 1;
+    send_json_response(conn, 500, "{\"error\":\"Out of memory\"}");
+    return 0;
+}
+
+void handle_api_event_precedes(Connection* conn, Table* table, uint32_t a, uint32_t b) {
+    if (!indexes_ready(conn, table)) return;
+    int result;
+    if (!lookup_row(a, table, NULL) || !lookup_row(b, table, NULL)) {
+        send_json_response(conn, 404, "{\"error\":\"Event not found\"}");
+    } else if (!precedes(table, a, b, &result)) {
+        send_json_response(conn, 500, "{\"error\":\"Out of memory\"}");
     } else {
-        // For larger files, send headers first, then stream the content
-        char headers[512];
-        snprintf(headers, sizeof(headers),
-            "HTTP/1.1 200 OK\r\n"
-            "Content-Type: %s\r\n"
-            "Access-Control-Allow-Origin: *\r\n"
-            "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
-            "Access-Control-Allow-Headers: Content-Type\r\n"
-            "Content-Length: %ld\r\n"
-            "\r\n",
-            content_type, file_size);
-        
-        send(client_socket, headers, strlen(headers), 0);
-        
-        // Stream file content in chunks
-        char chunk[BUFFER_SIZE];
-        size_t bytes_read;
-        while ((bytes_read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
-            send(client_socket, chunk, bytes_read, 0);
-        }
-        
-        fclose(file);
+        char json_response[128];
+        snprintf(json_response, sizeof(json_response), "{\"a\":%u,\"b\":%u,\"precedes\":%s}",
+                 a, b, result ? "true" : "false");
+        send_json_response(conn, 200, json_response);
     }
 }
 
-char* get_content_type(const char* path) {
-    if (strcmp(path, "/") == 0 || strstr(path, ".html")) return "text/html";
-    if (strstr(path, ".css")) return "text/css";
-    if (strstr(path, ".js")) return "application/javascript";
-    if (strstr(path, ".json")) return "application/json";
-    return "text/plain";
+void handle_api_event_common_ancestors(Connection* conn, HTTPRequest* req, Table* table, uint32_t a, uint32_t b) {
+    if (!indexes_ready(conn, table)) return;
+
+    Traversal result;
+    if (!lookup_row(a, table, NULL) || !lookup_row(b, table, NULL)) {
+        send_json_response(conn, 404, "{\"error\":\"Event not found\"}");
+        return;
+    }
+    if (!common_ancestors(table, a, b, &result)) {
+        send_json_response(conn, 500, "{\"error\":\"Out of memory\"}");
+        return;
+    }
+
+    stream_rows(conn, req, &result);
 }
 
-void handle_api_events(int client_socket, HTTPRequest* req) {
-    if (strcmp(req->method, "GET") == 0) {
-        // Get all events
-        Table* table = load_table("causal.cdb");
-        if (!table) {
-            send_json_response(client_socket, 500, "{\"error\":\"Failed to load database\"}");
+// GET /api/search?q=<words>[&ancestors_of=<id>|&descendants_of=<id>]
+// returns the events whose data contains every word, optionally only
+// those among the ancestors or descendants of an event.
+void handle_api_search(Connection* conn, HTTPRequest* req, Table* table) {
+    char query[MAX_PATH_LENGTH + 1];
+    int query_len = get_query_string(req->path, "q", query, sizeof(query));
+    if (query_len < 0) {
+        send_json_response(conn, 400, "{\"error\":\"Missing q parameter\"}");
+        return;
+    }
+
+    if (!indexes_ready(conn, table)) return;
+
+    Traversal result;
+    if (!search_events(table, query, (size_t)query_len, &result)) {
+        send_json_response(conn, 500, "{\"error\":\"Out of memory\"}");
+        return;
+    }
+
+    const char* ancestors_of = find_query_param(req->path, "ancestors_of");
+    const char* descendants_of = find_query_param(req->path, "descendants_of");
+    if (ancestors_of || descendants_of) {
+        Traversal scope;
+        uint32_t id = (uint32_t)strtoul(ancestors_of ? ancestors_of : descendants_of, NULL, 10);
+        if (!traverse(table, id, ancestors_of ? TRAVERSE_ANCESTORS : TRAVERSE_DESCENDANTS, 0, 0, &scope)) {
+            send_json_response(conn, 404, "{\"error\":\"Event not found\"}");
+            free_traversal(&result);
             return;
         }
-        
-        char json_response[BUFFER_SIZE] = "[";
-        int first = 1;
-        
-        for (size_t i = 0; i < table->num_events; i++) {
-            Event* event = &table->events[i];
-            
-            if (!first) strcat(json_response, ",");
-            first = 0;
-            
-            char event_json[512];
-            snprintf(event_json, sizeof(event_json),
-                "{\"id\":%u,\"data\":\"%s\",\"parent_count\":%u,\"parents\":[",
-                event->id, event->data, event->parent_count);
-            
-            strcat(json_response, event_json);
-            
-            for (int j = 0; j < event->parent_count; j++) {
-                if (j > 0) strcat(json_response, ",");
-                char parent_id[16];
-                snprintf(parent_id, sizeof(parent_id), "%u", event->parents[j]);
-                strcat(json_response, parent_id);
-            }
-            
-            strcat(json_response, "]}");
-        }
-        
-        strcat(json_response, "]");
-        send_json_response(client_socket, 200, json_response);
-        
-        free(table);
-    } else if (strcmp(req->method, "POST") == 0) {
-        // Add new event
-        // Parse JSON from request body
-        char* json_start = strstr(req->body, "{");
-        if (!json_start) {
-            send_json_response(client_socket, 400, "{\"error\":\"Invalid JSON\"}");
+        int ok = intersect_traversal(table, &result, &scope);
+        free_traversal(&scope);
+        if (!ok) {
+            send_json_response(conn, 500, "{\"error\":\"Out of memory\"}");
+            free_traversal(&result);
             return;
         }
-        
-        // Simple JSON parsing (in production, use a proper JSON library)
-        uint32_t id = 0;
-        char data[MAX_DATA_LENGTH] = {0};
-        uint32_t parents[MAX_PARENTS] = {0};
-        int parent_count = 0;
-        
-        // Extract ID
-        char* id_start = strstr(json_start, "\"id\":");
-        if (id_start) {
-            sscanf(id_start, "\"id\":%u", &id);
-        }
-        
-        // Extract data
-        char* data_start = strstr(json_start, "\"data\":\"");
-        if (data_start) {
-            data_start += 8; // Skip "data":"
-            char* data_end = strchr(data_start, '"');
-            if (data_end) {
-                int data_len = data_end - data_start;
-                if (data_len >= MAX_DATA_LENGTH) data_len = MAX_DATA_LENGTH - 1;
-                strncpy(data, data_start, data_len);
-                data[data_len] = '\0';
-            }
+    }
+
+    stream_rows(conn, req, &result);
+}
+
+// Wakes the workers that have subscribers to send them what was just
+// inserted. The count is read after the insert was published and a new
+// subscriber reads the table after it is counted, so between them every
+// event reaches it.
+void notify_workers() {
+    uint64_t one = 1;
+    for (long i = 0; i < num_workers; i++) {
+        if (__atomic_load_n(&workers[i].num_subscribers, __ATOMIC_SEQ_CST) > 0) {
+            // Fails only if the counter is full, when a wakeup is pending anyway
+            ssize_t written = write(workers[i].notify_fd, &one, sizeof(one));
+            (void)written;
+        }
+    }
+}
+
+// Makes `conn` one of the subscribers `worker` tails; continue_tail()
+// sends them the events from `conn->tail_row` on.
+int add_subscriber(Worker* worker, Connection* conn) {
+    if (conn->subscribed) return 1;
+    if (worker->num_subscribers == worker->subscribers_cap) {
+        size_t capacity = worker->subscribers_cap ? worker->subscribers_cap * 2 : 16;
+        Connection** grown = realloc(worker->subscribers, capacity * sizeof(Connection*));
+        if (!grown) return 0;
+        worker->subscribers = grown;
+        worker->subscribers_cap = capacity;
+    }
+    worker->subscribers[worker->num_subscribers] = conn;
+    __atomic_store_n(&worker->num_subscribers, worker->num_subscribers + 1, __ATOMIC_SEQ_CST);
+    conn->subscribed = 1;
+    return 1;
+}
+
+// Inserts are applied by a single writer thread, so that no worker waits
+// on the writer lock, the reader drain or fdatasync. Whatever queues up
+// while the writer is busy goes in together, with one publish and one
+// commit.
+pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t write_queued = PTHREAD_COND_INITIALIZER;
+SnapshotWrite* write_queue;
+SnapshotWrite** write_queue_tail = &write_queue;
+
+// Starts an insert for `conn`, whose events will point into its input.
+PendingWrite* new_pending_write(Connection* conn) {
+    PendingWrite* pending = calloc(1, sizeof(PendingWrite));
+    if (!pending) return NULL;
+    pending->conn = conn;
+    pending->worker = conn->reader_slot;
+    blob_heap_init(&pending->overflow);
+    return pending;
+}
+
+void free_pending_write(PendingWrite* pending) {
+    free(pending->write.events);
+    free(pending->input);
+    blob_heap_free(&pending->overflow);
+    free(pending);
+}
+
+// Hands an insert to the writer. The connection handles nothing after it
+// until finish_writes() has replied.
+void queue_write(Connection* conn, PendingWrite* pending) {
+    conn->write = pending;
+    pending->write.next = NULL;
+    pthread_mutex_lock(&write_lock);
+    *write_queue_tail = &pending->write;
+    write_queue_tail = &pending->write.next;
+    pthread_cond_signal(&write_queued);
+    pthread_mutex_unlock(&write_lock);
+}
+
+// Once the request or frame ending at `length` has queued a write, gives
+// the connection's input buffer, which the write's events point into, to
+// the write. Whatever was pipelined after it moves to a new buffer.
+void hand_over_input(Connection* conn, size_t length) {
+    size_t rest = conn->in_len - length;
+    size_t capacity = rest + 1 > READ_CHUNK * 2 ? rest + 1 : READ_CHUNK * 2;
+    char* fresh = malloc(capacity);
+    conn->write->input = conn->in;
+    if (!fresh) {
+        // Nothing more can be read, so the insert's reply is the last one
+        conn->in = NULL;
+        conn->in_cap = 0;
+        conn->in_len = 0;
+        conn->close_after = 1;
+        return;
+    }
+    memcpy(fresh, conn->in + length, rest);
+    conn->in = fresh;
+    conn->in_cap = capacity;
+    conn->in_len = rest;
+}
+
+void* run_writer(void* arg) {
+    (void)arg;
+    uint64_t one = 1;
+    while (1) {
+        pthread_mutex_lock(&write_lock);
+        while (!write_queue) pthread_cond_wait(&write_queued, &write_lock);
+        SnapshotWrite* writes = write_queue;
+        write_queue = NULL;
+        write_queue_tail = &write_queue;
+        pthread_mutex_unlock(&write_lock);
+
+        snapshot_insert(&store, writes);
+
+        // The owning worker may free a write as soon as it is on its list
+        int inserted = 0;
+        SnapshotWrite* next;
+        for (SnapshotWrite* done = writes; done; done = next) {
+            next = done->next;
+            if (done->result == INSERT_SUCCESS) inserted = 1;
+            PendingWrite* pending = (PendingWrite*)done;
+            Worker* worker = &workers[pending->worker];
+            pthread_mutex_lock(&worker->finished_lock);
+            pending->next_finished = worker->finished;
+            worker->finished = pending;
+            pthread_mutex_unlock(&worker->finished_lock);
+            ssize_t written = write(worker->notify_fd, &one, sizeof(one));
+            (void)written;
         }
-        
-        // Extract parents
-        char* parents_start = strstr(json_start, "\"parents\":[");
-        if (parents_start) {
-            parents_start += 11; // Skip "parents":[
-            char* parents_end = strchr(parents_start, ']');
-            if (parents_end) {
-                char parents_str[256] = {0};
-                int parents_len = parents_end - parents_start;
-                if (parents_len >= sizeof(parents_str)) parents_len = sizeof(parents_str) - 1;
-                strncpy(parents_str, parents_start, parents_len);
-                parents_str[parents_len] = '\0';
-                
-                // Parse parent IDs
-                char* token = strtok(parents_str, ",");
-                while (token && parent_count < MAX_PARENTS) {
-                    parents[parent_count++] = atoi(token);
-                    token = strtok(NULL, ",");
-                }
+        if (inserted) notify_workers();
+    }
+    return NULL;
+}
+
+// Accepts either a single event object or a JSON array of events. An
+// array is validated and written as one batch: all of it or none of it.
+// The writer thread inserts it; reply_to_write() answers.
+void handle_api_events_post(Connection* conn, HTTPRequest* req) {
+    // Events are parsed in place in the body and point into it; long
+    // parent lists go to the pending write's `overflow`.
+    PendingWrite* pending = new_pending_write(conn);
+    if (!pending) {
+        send_json_response(conn, 500, "{\"error\":\"Out of memory\"}");
+        return;
+    }
+    char* json = req->body;
+    while (*json == ' ' || *json == '\t' || *json == '\r' || *json == '\n') json++;
+    int is_array = *json == '[';
+    if (is_array) json++;
+
+    size_t count = 0;
+    size_t capacity = is_array ? 64 : 1;
+    Event* events = malloc(capacity * sizeof(Event));
+    pending->write.events = events;
+    if (!events) {
+        free_pending_write(pending);
+        send_json_response(conn, 500, "{\"error\":\"Out of memory\"}");
+        return;
+    }
+
+    while (1) {
+        if (count == capacity) {
+            Event* grown = realloc(events, capacity * 2 * sizeof(Event));
+            if (!grown) {
+                free_pending_write(pending);
+                send_json_response(conn, 500, "{\"error\":\"Out of memory\"}");
+                return;
             }
+            events = pending->write.events = grown;
+            capacity *= 2;
         }
-        
-        // Validate input
-        if (id == 0) {
-            send_json_response(client_socket, 400, "{\"error\":\"Invalid event ID\"}");
+        if (!parse_event_json(&json, &events[count], &pending->overflow)) {
+            free_pending_write(pending);
+            send_json_response(conn, 400, "{\"error\":\"Invalid JSON or event ID\"}");
             return;
         }
-        
-        if (strlen(data) == 0) {
-            send_json_response(client_socket, 400, "{\"error\":\"Event data cannot be empty\"}");
+        if (events[count].data_length == 0) {
+            free_pending_write(pending);
+            send_json_response(conn, 400, "{\"error\":\"Event data cannot be empty\"}");
             return;
         }
-        
-        // Create and insert event
-        Event event;
-        event.id = id;
-        strncpy(event.data, data, MAX_DATA_LENGTH - 1);
-        event.data[MAX_DATA_LENGTH - 1] = '\0';
-        event.parent_count = parent_count;
-        for (int i = 0; i < parent_count; i++) {
-            event.parents[i] = parents[i];
-        }
-        
-        Table* table = load_table("causal.cdb");
-        if (!table) {
-            send_json_response(client_socket, 500, "{\"error\":\"Failed to load database\"}");
+        count++;
+
+        if (!is_array) break;
+        while (*json == ' ' || *json == '\t' || *json == '\r' || *json == '\n') json++;
+        if (*json == ',') {
+            json++;
+        } else if (*json == ']') {
+            break;
+        } else {
+            free_pending_write(pending);
+            send_json_response(conn, 400, "{\"error\":\"Invalid JSON\"}");
             return;
         }
-        
-        insert_event(&event, table);
-        free(table);
-        
-        send_json_response(client_socket, 201, "{\"message\":\"Event created successfully\"}");
     }
+
+    pending->write.count = count;
+    pending->is_array = is_array;
+    queue_write(conn, pending);
 }
 
-void handle_request(int client_socket) {
-    char buffer[BUFFER_SIZE];
-    int bytes_received = recv(client_socket, buffer, BUFFER_SIZE - 1, 0);
-    if (bytes_received <= 0) return;
-    
-    buffer[bytes_received] = '\0';
-    
-    HTTPRequest req;
-    memset(&req, 0, sizeof(HTTPRequest)); // Initialize to zero
-    parse_http_request(buffer, &req);
-    
-    // Validate request
-    if (strlen(req.method) == 0 || strlen(req.path) == 0) {
-        HTTPResponse resp;
-        resp.status_code = 400;
-        strcpy(resp.status_text, "Bad Request");
-        strcpy(resp.content_type, "text/plain");
-        strcpy(resp.body, "Invalid request");
-        resp.body_length = strlen(resp.body);
-        send_http_response(client_socket, &resp);
+// GET /api/events?format=columnar sends the columnar export (export.h) of
+// the events published when the request arrived. It is built a block of
+// rows at a time by continue_columnar_export(), so that inserts need not
+// wait for all of it.
+void start_columnar_export(Connection* conn, Table* table) {
+    EventStream* stream = &conn->stream;
+    stream->columnar = malloc(sizeof(ColumnarExport));
+    if (!stream->columnar || !columnar_begin(stream->columnar, (uint32_t)table->num_events)) {
+        end_stream(stream);
+        send_json_response(conn, 500, "{\"error\":\"Out of memory\"}");
+        return;
+    }
+    stream->active = 1;
+}
+
+// Adds the next block of rows to the columnar export on `conn`, holding
+// the snapshot only for those. The finished export is written to an
+// unlinked temporary file that is then sent with sendfile() and closed.
+void continue_columnar_export(Connection* conn) {
+    EventStream* stream = &conn->stream;
+    ColumnarExport* builder = stream->columnar;
+    int side;
+    Table* table = snapshot_acquire(&store, conn->reader_slot, &side);
+    int ok = columnar_add_rows(builder, table, COLUMNAR_BLOCK_ROWS);
+    snapshot_release(&store, conn->reader_slot, side);
+    if (ok && builder->next_row < builder->end_row) return;
+
+    FILE* file = ok ? tmpfile() : NULL;
+    ok = file && columnar_write(builder, file);
+    end_stream(stream);
+    if (!ok) {
+        if (file) fclose(file);
+        send_json_response(conn, 500, "{\"error\":\"Export failed\"}");
+        return;
+    }
+    long size = ftell(file);
+    int fd = dup(fileno(file));
+    fclose(file);
+    if (fd < 0 || size < 0) {
+        if (fd >= 0) close(fd);
+        send_json_response(conn, 500, "{\"error\":\"Export failed\"}");
+        return;
+    }
+    send_response_headers(conn, 200, "OK", "application/octet-stream", (size_t)size, NULL);
+    conn->file_fd = fd;
+    conn->file_offset = 0;
+    conn->file_remaining = (size_t)size;
+    conn->file_owned = 1;
+}
+
+// GET /api/events[?q=<text>][&offset=<n>][&limit=<n>][&after=<id>]
+// streams every event, or those whose data contains <text>, in insertion
+// order. `after` continues a previous page from the last id it returned.
+// With ?format=binary the events are sent as a binary export instead of
+// JSON. The response is only set up here; continue_stream() produces it.
+void start_event_stream(Connection* conn, HTTPRequest* req, Table* table) {
+    EventStream* stream = &conn->stream;
+    char format[16] = "json";
+    get_query_string(req->path, "format", format, sizeof(format));
+    if (strcmp(format, "columnar") == 0) {
+        start_columnar_export(conn, table);
+        return;
+    } else if (strcmp(format, "binary") != 0 && strcmp(format, "json") != 0) {
+        send_json_response(conn, 400, "{\"error\":\"Unknown format\"}");
+        return;
+    }
+
+    uint32_t start = 0;
+    const char* after = find_query_param(req->path, "after");
+    if (after) {
+        if (!lookup_row((uint32_t)strtoul(after, NULL, 10), table, &start)) {
+            send_json_response(conn, 404, "{\"error\":\"Event not found\"}");
+            return;
+        }
+        start++;
+    }
+
+    stream->binary = strcmp(format, "binary") == 0;
+    stream->query_length = get_query_string(req->path, "q", stream->query, sizeof(stream->query));
+    stream->next_row = start;
+    stream->end_row = (uint32_t)table->num_events;
+    stream->skip = get_query_param(req->path, "offset", 0);
+    stream->remaining = get_query_param(req->path, "limit", (unsigned long)-1);
+    stream->rows = NULL;
+    begin_stream(conn, req, NULL);
+}
+
+// Advances `stream` to the next row it sends. Returns 0 if there is none
+// left in this snapshot.
+int next_stream_row(EventStream* stream, Table* table, uint32_t* out) {
+    while (stream->next_row < stream->end_row && stream->remaining > 0) {
+        uint32_t row = stream->rows ? stream->rows[stream->next_row] : stream->next_row;
+        stream->next_row++;
+        if (!is_served_row(table, row)) continue;
+        if (stream->query_length > 0 &&
+            !scan_substring(table->data[row], table->data_lengths[row], stream->query,
+                            (size_t)stream->query_length)) {
+            continue;
+        }
+        if (stream->skip > 0) {
+            stream->skip--;
+            continue;
+        }
+        stream->sent++;
+        stream->remaining--;
+        *out = row;
+        return 1;
+    }
+    return 0;
+}
+
+// Queues one frame of up to EXPORT_FRAME_EVENTS events of a binary export.
+// Once the stream is done that is the empty frame that closes it.
+int queue_export_frame(Connection* conn, Table* table) {
+    EventStream* stream = &conn->stream;
+    Event events[EXPORT_FRAME_EVENTS];
+    size_t count = 0;
+    uint32_t row;
+    while (count < EXPORT_FRAME_EVENTS && next_stream_row(stream, table, &row)) {
+        table_event(table, row, &events[count++]);
+    }
+    // A frame that would be empty before the end is left out
+    if (count == 0 && stream->next_row < stream->end_row && stream->remaining > 0) return 1;
+
+    size_t size = wire_batch_size(events, count);
+    uint8_t* dest = (uint8_t*)conn_reserve(conn, size);
+    if (!dest) return 0;
+    wire_write_batch(dest, WIRE_EVENTS, 0, stream->next_row, events, count);
+    conn->out_len += size;
+    return 1;
+}
+
+// Queues up to STREAM_CHUNK_SIZE more of the event stream on `conn` as one
+// chunk, and the closing chunk once it is complete. The snapshot is held
+// only while the chunk is written, so a slow client never holds up inserts.
+void continue_stream(Connection* conn) {
+    EventStream* stream = &conn->stream;
+    if (stream->columnar) {
+        continue_columnar_export(conn);
+        return;
+    }
+    if (!conn_reserve(conn, CHUNK_HEADER_SIZE + EXPORT_HEADER_SIZE)) {
+        end_stream(stream);
+        return;
+    }
+    // Offsets rather than pointers: the queue may move as it grows
+    size_t frame = conn->out_len;
+    if (stream->chunked) conn->out_len += CHUNK_HEADER_SIZE;
+    size_t body = conn->out_len;
+    if (!stream->started && stream->binary) {
+        write_export_header((uint8_t*)conn->out + conn->out_len);
+        conn->out_len += EXPORT_HEADER_SIZE;
+    } else if (!stream->started) {
+        conn->out[conn->out_len++] = '[';
+    }
+    stream->started = 1;
+
+    int ok = 1;
+    int side;
+    Table* table = snapshot_acquire(&store, conn->reader_slot, &side);
+    while (ok && stream->binary && conn->out_len - body < STREAM_CHUNK_SIZE &&
+           stream->next_row < stream->end_row && stream->remaining > 0) {
+        ok = queue_export_frame(conn, table);
+    }
+    uint32_t row;
+    while (!stream->binary && conn->out_len - body < STREAM_CHUNK_SIZE && next_stream_row(stream, table, &row)) {
+        char* dest = conn_reserve(conn, EVENT_JSON_SIZE + 1);
+        if (!dest) {
+            ok = 0;
+            break;
+        }
+        if (stream->sent > 1) *dest++ = ',';
+        Event event;
+        table_event(table, row, &event);
+        conn->out_len += (stream->sent > 1) + format_event_json(&event, dest);
+    }
+    int done = stream->next_row >= stream->end_row || stream->remaining == 0;
+    if (ok && done) ok = stream->binary ? queue_export_frame(conn, table) : conn_write(conn, "]", 1);
+    snapshot_release(&store, conn->reader_slot, side);
+
+    if (ok && stream->chunked) {
+        char header[CHUNK_HEADER_SIZE + 1];
+        snprintf(header, sizeof(header), "%08zx\r\n", conn->out_len - body);
+        memcpy(conn->out + frame, header, CHUNK_HEADER_SIZE);
+        ok = conn_write(conn, done ? "\r\n0\r\n\r\n" : "\r\n", done ? 7 : 2);
+    }
+    // Out of memory, conn_reserve() has already arranged to hang up and
+    // the client sees the body cut short.
+    if (!ok || done) end_stream(stream);
+}
+
+// GET /api/events/stream pushes every event inserted from then on as a
+// server-sent event. A client resumes from the position in the id of the
+// last one it saw, sent as Last-Event-ID or ?from=<position>, or after the
+// event ?after=<id>. The response never ends; continue_tail() adds to it
+// whenever an insert wakes the worker.
+void start_event_feed(Connection* conn, HTTPRequest* req, Table* table) {
+    uint32_t start = (uint32_t)table->num_events;
+    const char* after = find_query_param(req->path, "after");
+    if (req->last_event_id) {
+        start = (uint32_t)strtoul(req->last_event_id, NULL, 10);
+    } else if (find_query_param(req->path, "from")) {
+        start = (uint32_t)get_query_param(req->path, "from", 0);
+    } else if (after) {
+        if (!lookup_row((uint32_t)strtoul(after, NULL, 10), table, &start)) {
+            send_json_response(conn, 404, "{\"error\":\"Event not found\"}");
+            return;
+        }
+        start++;
+    }
+
+    if (!add_subscriber(&workers[conn->reader_slot], conn)) {
+        send_json_response(conn, 500, "{\"error\":\"Out of memory\"}");
         return;
     }
+    conn->tail_row = start;
+    conn->stream.chunked = req->http11;
+    conn->close_after = 0; // The response lasts until the client hangs up
+    send_response_headers(conn, 200, "OK", "text/event-stream", STREAMED_LENGTH,
+                          "Cache-Control: no-cache\r\n");
+}
+
+// `table` is the snapshot to answer queries from, NULL for inserts.
+void handle_api_events(Connection* conn, HTTPRequest* req, Table* table) {
+    if (strcmp(req->method, "GET") == 0 && path_matches(req->path, "/api/events/stream")) {
+        start_event_feed(conn, req, table);
+    } else if (strcmp(req->method, "GET") == 0 && strncmp(req->path, "/api/events/", 12) == 0) {
+        char* rest;
+        uint32_t id = (uint32_t)strtoul(req->path + 12, &rest, 10);
+        if (path_matches(rest, "/children")) {
+            handle_api_event_children(conn, req, table, id);
+        } else if (path_matches(rest, "/ancestors")) {
+            handle_api_event_traversal(conn, req, table, id, TRAVERSE_ANCESTORS);
+        } else if (path_matches(rest, "/descendants")) {
+            handle_api_event_traversal(conn, req, table, id, TRAVERSE_DESCENDANTS);
+        } else if (strncmp(rest, "/precedes/", 10) == 0) {
+            handle_api_event_precedes(conn, table, id, (uint32_t)strtoul(rest + 10, NULL, 10));
+        } else if (strncmp(rest, "/common_ancestors/", 18) == 0) {
+            handle_api_event_common_ancestors(conn, req, table, id, (uint32_t)strtoul(rest + 18, NULL, 10));
+        } else {
+            handle_api_event_by_id(conn, table, id);
+        }
+    } else if (strcmp(req->method, "GET") == 0) {
+        start_event_stream(conn, req, table);
+    } else if (strcmp(req->method, "POST") == 0) {
+        handle_api_events_post(conn, req);
+    } else {
+        send_json_response(conn, 405, "{\"error\":\"Method not allowed\"}");
+    }
+}
+
+// Handles one parsed request, queueing the response on `conn`.
+void handle_request(Connection* conn, HTTPRequest* request) {
+    HTTPRequest req = *request;
+    if (!req.keep_alive) conn->close_after = 1;
     
     // Handle CORS preflight
     if (strcmp(req.method, "OPTIONS") == 0) {
@@ -356,70 +1277,613 @@ void handle_request(int client_socket) {
         strcpy(resp.content_type, "text/plain");
         strcpy(resp.body, "");
         resp.body_length = 0;
-        send_http_response(client_socket, &resp);
+        send_http_response(conn, &resp);
         return;
     }
     
-    // Handle API routes
+    // Handle API routes. Queries each read one snapshot from start to
+    // finish; inserts publish a new one when they are done.
+    int is_query = strcmp(req.method, "GET") == 0;
+    int side;
     if (strncmp(req.path, "/api/events", 11) == 0) {
-        handle_api_events(client_socket, &req);
+        Table* table = is_query ? snapshot_acquire(&store, conn->reader_slot, &side) : NULL;
+        handle_api_events(conn, &req, table);
+        if (is_query) snapshot_release(&store, conn->reader_slot, side);
+        return;
+    }
+    if (path_matches(req.path, "/api/search") && is_query) {
+        Table* table = snapshot_acquire(&store, conn->reader_slot, &side);
+        handle_api_search(conn, &req, table);
+        snapshot_release(&store, conn->reader_slot, side);
         return;
     }
     
     // Handle static files
-    char file_path[512];
-    if (strcmp(req.path, "/") == 0) {
-        strcpy(file_path, "../frontend/index.html");
+    send_asset_response(conn, &req);
+}
+
+void send_wire_ack(Connection* conn, uint32_t tag, uint32_t status, uint32_t count) {
+    uint8_t* dest = (uint8_t*)conn_reserve(conn, WIRE_HEADER_SIZE + 8);
+    if (!dest) return;
+    wire_write_header(dest, WIRE_HEADER_SIZE + 8, WIRE_ACK, tag);
+    store_le32(dest + WIRE_HEADER_SIZE, status);
+    store_le32(dest + WIRE_HEADER_SIZE + 4, count);
+    conn->out_len += WIRE_HEADER_SIZE + 8;
+}
+
+// Inserts the batch in a WIRE_INSERT frame, all of it or none of it,
+// through the writer thread. Returns 0 if the frame is malformed.
+int handle_wire_insert(Connection* conn, uint32_t tag, const uint8_t* body, size_t length) {
+    if (length < WIRE_BATCH_HEADER_SIZE || wire_batch_count(body) > (length - WIRE_BATCH_HEADER_SIZE) / ROW_SIZE) {
+        return 0;
+    }
+    size_t count = wire_batch_count(body);
+    if (count == 0) {
+        send_wire_ack(conn, tag, WIRE_OK, 0);
+        return 1;
+    }
+
+    // Events point into the frame; long parent lists go to the pending
+    // write's `overflow`
+    PendingWrite* pending = new_pending_write(conn);
+    Event* events = malloc(count * sizeof(Event));
+    if (!pending || !events) {
+        if (pending) free_pending_write(pending);
+        free(events);
+        send_wire_ack(conn, tag, INSERT_OUT_OF_MEMORY, 0);
+        return 1;
+    }
+    pending->write.events = events;
+    if (!wire_read_batch(body, length, events, &pending->overflow)) {
+        free_pending_write(pending);
+        return 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].data_length == 0) {
+            free_pending_write(pending);
+            send_wire_ack(conn, tag, WIRE_EMPTY_DATA, 0);
+            return 1;
+        }
+    }
+
+    pending->write.count = count;
+    pending->tag = tag;
+    queue_write(conn, pending);
+    return 1;
+}
+
+// Queues the reply to an insert the writer has finished.
+void reply_to_write(Connection* conn, PendingWrite* pending) {
+    InsertResult result = pending->write.result;
+    if (conn->binary) {
+        send_wire_ack(conn, pending->tag, result, result == INSERT_SUCCESS ? (uint32_t)pending->write.count : 0);
+    } else if (result == INSERT_DUPLICATE_ID) {
+        send_json_response(conn, 409, "{\"error\":\"Event ID already exists\"}");
+    } else if (result == INSERT_DATA_TOO_LONG) {
+        send_json_response(conn, 400, "{\"error\":\"Event data is too long\"}");
+    } else if (result == INSERT_TOO_MANY_PARENTS) {
+        send_json_response(conn, 400, "{\"error\":\"Event has too many parents\"}");
+    } else if (result != INSERT_SUCCESS) {
+        send_json_response(conn, 500, "{\"error\":\"Failed to store event\"}");
+    } else if (pending->is_array) {
+        char json_response[64];
+        snprintf(json_response, sizeof(json_response), "{\"message\":\"%zu events created\"}", pending->write.count);
+        send_json_response(conn, 201, json_response);
     } else {
-        snprintf(file_path, sizeof(file_path), "../frontend%s", req.path);
+        send_json_response(conn, 201, "{\"message\":\"Event created successfully\"}");
+    }
+}
+
+// Starts or moves a subscription; continue_tail() sends the events.
+void handle_wire_subscribe(Worker* worker, Connection* conn, uint32_t tag, uint32_t position) {
+    if (position == WIRE_SUBSCRIBE_FROM_END) {
+        int side;
+        Table* table = snapshot_acquire(&store, conn->reader_slot, &side);
+        position = (uint32_t)table->num_events;
+        snapshot_release(&store, conn->reader_slot, side);
+    }
+    if (!add_subscriber(worker, conn)) {
+        send_wire_ack(conn, tag, INSERT_OUT_OF_MEMORY, 0);
+        return;
+    }
+    conn->tail_row = position;
+    conn->tail_tag = tag;
+    send_wire_ack(conn, tag, WIRE_OK, 0);
+}
+
+// Handles every complete frame buffered on `conn`, in order. A malformed
+// one is answered and the connection closed, as what follows it cannot be
+// framed.
+void process_frames(Worker* worker, Connection* conn) {
+    size_t consumed = 0;
+    while (!conn->close_after && !conn->write && conn->in_len - consumed >= WIRE_HEADER_SIZE) {
+        const uint8_t* frame = (const uint8_t*)conn->in + consumed;
+        uint32_t length = load_le32(frame);
+        uint32_t type = load_le32(frame + 4);
+        uint32_t tag = load_le32(frame + 8);
+        if (length < WIRE_HEADER_SIZE || length > WIRE_MAX_FRAME) {
+            send_wire_ack(conn, tag, WIRE_MALFORMED, 0);
+            conn->close_after = 1;
+            break;
+        }
+        if (conn->in_len - consumed < length) break;
+
+        const uint8_t* body = frame + WIRE_HEADER_SIZE;
+        size_t body_length = length - WIRE_HEADER_SIZE;
+        int ok = 1;
+        if (type == WIRE_INSERT) {
+            ok = handle_wire_insert(conn, tag, body, body_length);
+        } else if (type == WIRE_SUBSCRIBE) {
+            ok = body_length == 4;
+            if (ok) handle_wire_subscribe(worker, conn, tag, load_le32(body));
+        } else {
+            send_wire_ack(conn, tag, WIRE_UNKNOWN_TYPE, 0);
+        }
+        if (!ok) {
+            send_wire_ack(conn, tag, WIRE_MALFORMED, 0);
+            conn->close_after = 1;
+        }
+        consumed += length;
+    }
+    // A write pending on entry stops the loop before anything is consumed
+    if (conn->write && consumed > 0) {
+        hand_over_input(conn, consumed);
+    } else {
+        conn->in_len -= consumed;
+        memmove(conn->in, conn->in + consumed, conn->in_len);
+    }
+}
+
+// Queues one WIRE_EVENTS frame of the events from `tail_row` on.
+// Returns 0 if out of memory.
+int queue_wire_events(Connection* conn, Table* table, uint32_t end_row) {
+    Event events[TAIL_BATCH_EVENTS];
+    size_t count = 0;
+    uint32_t row = conn->tail_row;
+    while (row < end_row && count < TAIL_BATCH_EVENTS) {
+        if (is_served_row(table, row)) table_event(table, row, &events[count++]);
+        row++;
+    }
+    if (count > 0) {
+        size_t size = wire_batch_size(events, count);
+        uint8_t* dest = (uint8_t*)conn_reserve(conn, size);
+        if (!dest) return 0;
+        wire_write_batch(dest, WIRE_EVENTS, conn->tail_tag, row, events, count);
+        conn->out_len += size;
+    }
+    conn->tail_row = row;
+    return 1;
+}
+
+// Queues up to STREAM_CHUNK_SIZE of server-sent events from `tail_row` on,
+// as one chunk if the response is chunked. Each event's id is the position
+// after it, which a reconnecting client sends back as Last-Event-ID.
+// Returns 0 if out of memory.
+int queue_sse_events(Connection* conn, Table* table, uint32_t end_row) {
+    if (!conn_reserve(conn, CHUNK_HEADER_SIZE + 1)) return 0;
+    size_t frame = conn->out_len;
+    if (conn->stream.chunked) conn->out_len += CHUNK_HEADER_SIZE;
+    size_t body = conn->out_len;
+    while (conn->tail_row < end_row && conn->out_len - body < STREAM_CHUNK_SIZE) {
+        uint32_t row = conn->tail_row;
+        if (is_served_row(table, row)) {
+            char* dest = conn_reserve(conn, EVENT_JSON_SIZE + 32);
+            if (!dest) return 0;
+            Event event;
+            table_event(table, row, &event);
+            size_t len = (size_t)sprintf(dest, "id: %u\ndata: ", row + 1);
+            len += format_event_json(&event, dest + len);
+            memcpy(dest + len, "\n\n", 2);
+            conn->out_len += len + 2;
+        }
+        conn->tail_row++;
+    }
+
+    if (conn->out_len == body) {
+        conn->out_len = frame; // Nothing but rows that are not served
+    } else if (conn->stream.chunked) {
+        char header[CHUNK_HEADER_SIZE + 1];
+        snprintf(header, sizeof(header), "%08zx\r\n", conn->out_len - body);
+        memcpy(conn->out + frame, header, CHUNK_HEADER_SIZE);
+        return conn_write(conn, "\r\n", 2);
+    }
+    return 1;
+}
+
+// Queues what was inserted since the subscriber's position, until
+// TAIL_HIGH_WATER bytes are waiting to be sent, so a slow client holds
+// neither much memory nor the snapshot for long. Returns 1 if it stopped
+// there with events left over.
+int continue_tail(Connection* conn) {
+    int side;
+    Table* table = snapshot_acquire(&store, conn->reader_slot, &side);
+    uint32_t end_row = (uint32_t)table->num_events;
+    while (conn->tail_row < end_row && conn->out_len - conn->out_sent < TAIL_HIGH_WATER) {
+        int ok = conn->binary ? queue_wire_events(conn, table, end_row) : queue_sse_events(conn, table, end_row);
+        if (!ok) break;
+    }
+    int more = conn->tail_row < end_row;
+    snapshot_release(&store, conn->reader_slot, side);
+    return more && !conn->close_after;
+}
+
+void close_connection(Worker* worker, Connection* conn) {
+    if (conn->subscribed) {
+        for (size_t i = 0; i < worker->num_subscribers; i++) {
+            if (worker->subscribers[i] == conn) {
+                worker->subscribers[i] = worker->subscribers[worker->num_subscribers - 1];
+                __atomic_store_n(&worker->num_subscribers, worker->num_subscribers - 1, __ATOMIC_SEQ_CST);
+                break;
+            }
+        }
+    }
+    if (conn->write) conn->write->conn = NULL; // The writer's reply is dropped
+    if (conn->file_owned) close(conn->file_fd);
+    end_stream(&conn->stream);
+    close(conn->fd);
+    free(conn->in);
+    free(conn->out);
+    free(conn);
+}
+
+// Handles every complete request buffered on `conn`, in order.
+void process_requests(Connection* conn) {
+    while (!conn->close_after && !conn->stream.active && !conn->subscribed && !conn->write &&
+           conn->file_remaining == 0) {
+        RequestParser* parser = &conn->parser;
+        ParseState state = parse_request(parser, conn->in, conn->in_len);
+        if (state == PARSE_FAILED) {
+            char json_response[96];
+            snprintf(json_response, sizeof(json_response), "{\"error\":\"%s\"}",
+                     parser->error_status == 413 ? "Request too large" : get_status_text(parser->error_status));
+            conn->close_after = 1;
+            send_json_response(conn, parser->error_status, json_response);
+            break;
+        }
+        if (state != PARSE_DONE) break;
+
+        // The body is terminated in place; the byte after it is put back
+        // once the request has been handled.
+        size_t length = parser->body + parser->content_length;
+        char saved = conn->in[length];
+        conn->in[length] = '\0';
+        HTTPRequest req;
+        req.method = conn->in + parser->method;
+        req.path = conn->in + parser->path;
+        req.content_type = parser->content_type ? conn->in + parser->content_type : "text/plain";
+        req.if_none_match = parser->if_none_match ? conn->in + parser->if_none_match : "";
+        req.if_modified_since = parser->if_modified_since ? conn->in + parser->if_modified_since : "";
+        req.last_event_id = parser->last_event_id ? conn->in + parser->last_event_id : NULL;
+        req.body = conn->in + parser->body;
+        req.content_length = parser->content_length;
+        req.keep_alive = parser->keep_alive;
+        req.http11 = parser->http11;
+        req.accepts_gzip = parser->accepts_gzip;
+        handle_request(conn, &req);
+        conn->in[length] = saved;
+
+        if (conn->write) {
+            hand_over_input(conn, length);
+        } else {
+            conn->in_len -= length;
+            memmove(conn->in, conn->in + length, conn->in_len);
+        }
+        memset(parser, 0, sizeof(*parser));
+    }
+}
+
+// Reads whatever the client has sent. Returns 0 if the connection failed.
+int read_connection(Connection* conn) {
+    size_t max_request = MAX_HEADER_SIZE + MAX_BODY_SIZE;
+    while (conn->in_len < max_request) {
+        // Once the headers are in, the buffer grows straight to the full
+        // request instead of doubling its way there.
+        size_t wanted = conn->in_len + READ_CHUNK + 1;
+        if (conn->parser.state == PARSE_BODY && conn->parser.body + conn->parser.content_length + 1 > wanted) {
+            wanted = conn->parser.body + conn->parser.content_length + 1;
+        }
+        if (conn->binary && conn->in_len >= WIRE_HEADER_SIZE) {
+            uint32_t frame = load_le32((const uint8_t*)conn->in);
+            if (frame <= WIRE_MAX_FRAME && frame + 1 > wanted) wanted = frame + 1;
+        }
+        if (conn->in_cap < wanted) {
+            size_t capacity = conn->in_cap ? conn->in_cap * 2 : READ_CHUNK * 2;
+            if (capacity < wanted) capacity = wanted;
+            char* grown = realloc(conn->in, capacity);
+            if (!grown) return 0;
+            conn->in = grown;
+            conn->in_cap = capacity;
+        }
+        // One byte is always kept free for the terminator process_requests() writes.
+        ssize_t n = recv(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len - 1, 0);
+        if (n > 0) {
+            conn->in_len += (size_t)n;
+        } else if (n == 0) {
+            conn->peer_closed = 1;
+            return 1;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+    return 1;
+}
+
+// Sends as much queued output, and then file body, as the socket takes and
+// watches for writability while some is left. Returns 0 once the
+// connection should be closed.
+int flush_connection(Worker* worker, Connection* conn) {
+    while (conn->out_sent < conn->out_len || conn->file_remaining > 0) {
+        ssize_t n;
+        if (conn->out_sent < conn->out_len) {
+            n = send(conn->fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+            if (n > 0) conn->out_sent += (size_t)n;
+        } else {
+            // sendfile() advances `file_offset` itself
+            n = sendfile(conn->fd, conn->file_fd, &conn->file_offset, conn->file_remaining);
+            if (n > 0) conn->file_remaining -= (size_t)n;
+            if (conn->file_remaining == 0 && conn->file_owned) {
+                close(conn->file_fd);
+                conn->file_owned = 0;
+            }
+            if (n == 0) return 0; // The file shrank underneath us
+        }
+        if (n > 0 || (n < 0 && errno == EINTR)) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return 0;
+        }
+    }
+
+    int pending = conn->out_sent < conn->out_len || conn->file_remaining > 0;
+    if (!pending && !conn->stream.active && !conn->write && (conn->close_after || conn->peer_closed)) return 0;
+    if (pending != conn->want_write) {
+        struct epoll_event event;
+        event.events = pending ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        event.data.ptr = conn;
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event) != 0) return 0;
+        conn->want_write = pending;
+    }
+    return 1;
+}
+
+// Handles what has arrived on `conn` and sends the responses, producing
+// more of a streamed one each time the socket has taken everything queued.
+// Returns 0 once the connection should be closed.
+int service_connection(Worker* worker, Connection* conn) {
+    while (1) {
+        if (conn->binary) {
+            process_frames(worker, conn);
+        } else {
+            process_requests(conn);
+        }
+        if (conn->stream.active) continue_stream(conn);
+        int more = conn->subscribed && continue_tail(conn);
+        if (!flush_connection(worker, conn)) return 0;
+        if (conn->out_sent < conn->out_len || conn->file_remaining > 0) return 1; // The socket is full
+        if (conn->stream.active || more) continue;
+        if (conn->binary || conn->subscribed || conn->write ||
+            parse_request(&conn->parser, conn->in, conn->in_len) < PARSE_DONE) {
+            return 1;
+        }
     }
-    
-    send_file_response(client_socket, file_path, get_content_type(req.path));
 }
 
-int main() {
-    int server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket == -1) {
+// Replies to the inserts the writer has finished for this worker's
+// connections and carries on with what those had pipelined behind them.
+void finish_writes(Worker* worker) {
+    pthread_mutex_lock(&worker->finished_lock);
+    PendingWrite* finished = worker->finished;
+    worker->finished = NULL;
+    pthread_mutex_unlock(&worker->finished_lock);
+
+    while (finished) {
+        PendingWrite* pending = finished;
+        finished = pending->next_finished;
+        Connection* conn = pending->conn;
+        if (conn) {
+            conn->write = NULL;
+            reply_to_write(conn, pending);
+        }
+        free_pending_write(pending);
+        if (conn && !service_connection(worker, conn)) close_connection(worker, conn);
+    }
+}
+
+void accept_connections(Worker* worker, int listen_fd) {
+    while (1) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("Accept failed");
+            if (errno == EINTR) continue;
+            return;
+        }
+
+        Connection* conn = calloc(1, sizeof(Connection));
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        if (!conn || fcntl(fd, F_SETFL, O_NONBLOCK) != 0 ||
+            epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->reader_slot = worker->number;
+        conn->binary = listen_fd == worker->wire_fd;
+    }
+}
+
+void* run_worker(void* arg) {
+    Worker* worker = arg;
+    struct epoll_event events[MAX_WAIT_EVENTS];
+    while (1) {
+        int n = epoll_wait(worker->epoll_fd, events, MAX_WAIT_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            return NULL;
+        }
+
+        int notified = 0;
+        for (int i = 0; i < n; i++) {
+            void* ptr = events[i].data.ptr;
+            if (ptr == &worker->listen_fd || ptr == &worker->wire_fd) {
+                accept_connections(worker, *(int*)ptr);
+                continue;
+            }
+            if (ptr == &worker->notify_fd) {
+                uint64_t count;
+                ssize_t got = read(worker->notify_fd, &count, sizeof(count));
+                (void)got;
+                notified = 1;
+                continue;
+            }
+            Connection* conn = ptr;
+            if (events[i].events & EPOLLERR) {
+                close_connection(worker, conn);
+                continue;
+            }
+            if ((events[i].events & (EPOLLIN | EPOLLHUP)) && !read_connection(conn)) {
+                close_connection(worker, conn);
+                continue;
+            }
+            if (!service_connection(worker, conn)) close_connection(worker, conn);
+        }
+
+        // Only now, as a connection that fails is closed and later entries
+        // in `events` may refer to it. Subscribers still waiting for the
+        // socket carry on when it is writable.
+        if (notified) {
+            finish_writes(worker);
+            for (size_t i = worker->num_subscribers; i-- > 0;) {
+                Connection* conn = worker->subscribers[i];
+                if (!conn->want_write && !service_connection(worker, conn)) close_connection(worker, conn);
+            }
+        }
+    }
+}
+
+// Opens a nonblocking listening socket on `port`. Returns -1 on failure.
+int open_listener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
         perror("Socket creation failed");
-        exit(EXIT_FAILURE);
+        return -1;
     }
     
-    // Set socket options
+    // Every worker binds the same port; the kernel balances between them
     int opt = 1;
-    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) != 0) {
+        perror("SO_REUSEPORT failed");
+        close(fd);
+        return -1;
+    }
     
     struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(PORT);
+    server_addr.sin_port = htons(port);
     
-    if (bind(server_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+    if (bind(fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
         perror("Bind failed");
-        exit(EXIT_FAILURE);
+        close(fd);
+        return -1;
     }
     
-    if (listen(server_socket, MAX_CLIENTS) < 0) {
+    if (listen(fd, LISTEN_BACKLOG) < 0 || fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
         perror("Listen failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Opens this worker's listening sockets, wakeup eventfd and epoll
+// instance. Each is registered with a pointer to its descriptor in
+// `worker`, which tells it apart from the connections.
+int start_worker(Worker* worker) {
+    worker->listen_fd = open_listener(PORT);
+    worker->wire_fd = open_listener(WIRE_PORT);
+    if (worker->listen_fd < 0 || worker->wire_fd < 0) return 0;
+    worker->notify_fd = eventfd(0, EFD_NONBLOCK);
+    pthread_mutex_init(&worker->finished_lock, NULL);
+    worker->epoll_fd = epoll_create1(0);
+    if (worker->notify_fd < 0 || worker->epoll_fd < 0) {
+        perror("epoll");
+        return 0;
+    }
+
+    int* fds[] = {&worker->listen_fd, &worker->wire_fd, &worker->notify_fd};
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = fds[i];
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, *fds[i], &event) != 0) {
+            perror("epoll");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < argc; i++) {
+        Durability mode;
+        if (strncmp(argv[i], "--durability=", 13) == 0 && parse_durability(argv[i] + 13, &mode)) {
+            set_durability(mode);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0 && atol(argv[i] + 10) > 0) {
+            num_workers = atol(argv[i] + 10);
+        } else {
+            fprintf(stderr, "Usage: %s [--durability=none|group|full] [--threads=N]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (num_workers < 1) num_workers = 1;
+
+    LoadStats stats;
+    snapshot_store_open(&store, "causal.cdb", &stats);
+    load_assets();
+    printf("Loaded %zu events from causal.cdb\n", stats.rows_read);
+    signal(SIGPIPE, SIG_IGN);
+
+    workers = calloc((size_t)num_workers, sizeof(Worker));
+    if (!workers) {
+        perror("malloc");
         exit(EXIT_FAILURE);
     }
+    for (long i = 0; i < num_workers; i++) {
+        workers[i].number = (unsigned)i;
+        if (!start_worker(&workers[i])) exit(EXIT_FAILURE);
+    }
     
-    printf("CausalDB HTTP Server running on http://localhost:%d\n", PORT);
+    printf("CausalDB HTTP Server running on http://localhost:%d (%ld threads)\n", PORT, num_workers);
     printf("Frontend available at http://localhost:%d\n", PORT);
+    printf("Binary protocol on port %d\n", WIRE_PORT);
+    fflush(stdout);
     
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        
-        int client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &client_len);
-        if (client_socket < 0) {
-            perror("Accept failed");
-            continue;
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, run_writer, NULL) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    // The main thread serves as the first worker
+    for (long i = 1; i < num_workers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
         }
-        
-        handle_request(client_socket);
-        close(client_socket);
     }
+    run_worker(&workers[0]);
     
-    close(server_socket);
+    close_db();
+    snapshot_store_close(&store);
     return 0;
-} 
\ No newline at end of file
+}
@@ -0,0 +1,64 @@
+#include "crc32c.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78u
+
+static uint32_t crc_table[256];
+static int crc_table_ready;
+
+static void build_table() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+        }
+        crc_table[i] = crc;
+    }
+    crc_table_ready = 1;
+}
+
+static uint32_t crc32c_portable(const void* data, size_t length) {
+    if (!crc_table_ready) build_table();
+    const uint8_t* p = data;
+    uint32_t crc = 0xFFFFFFFFu;
+    while (length--) {
+        crc = (crc >> 8) ^ crc_table[(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
+
+#ifdef CRC32C_HAVE_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(const void* data, size_t length) {
+    const uint8_t* p = data;
+    uint64_t crc = 0xFFFFFFFFu;
+#ifdef __x86_64__
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc = _mm_crc32_u64(crc, word);
+        p += 8;
+        length -= 8;
+    }
+#endif
+    uint32_t crc32 = (uint32_t)crc;
+    while (length--) {
+        crc32 = _mm_crc32_u8(crc32, *p++);
+    }
+    return ~crc32;
+}
+#endif
+
+uint32_t crc32c(const void* data, size_t length) {
+#ifdef CRC32C_HAVE_SSE42
+    static int use_sse42 = -1;
+    if (use_sse42 < 0) use_sse42 = __builtin_cpu_supports("sse4.2");
+    if (use_sse42) return crc32c_sse42(data, length);
+#endif
+    return crc32c_portable(data, length);
+}
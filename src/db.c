@@ -1,72 +1,644 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // flock
 #include "db.h"
+#include "graph.h"
+#include "scan.h"
+#include "crc32c.h"
+#include "mapped.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <time.h>
+#include <unistd.h>
 
 
 
 FILE* db_file;
+static FILE* heap_file;
+static uint64_t heap_end; // Heap offset of the next payload, staged ones included
+static char text_index_name[4096];
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} LogBuffer;
+
+// Write-ahead log buffers. causal.cdb and its heap are themselves
+// append-only logs, so inserted rows and their payloads are staged here
+// and appended in groups, each group costing one write() per file and,
+// depending on the durability mode, one fdatasync() per file.
+//
+// Whoever calls commit_log() first while nothing is being written leads
+// the next group: it takes everything staged so far into the flush
+// buffers and writes them out without holding log_lock. Callers that
+// arrive meanwhile wait on log_flushed, and the rows they staged go out
+// together with the following group. A background flusher commits a
+// group that nobody waits for once it is due (see log_group_due()).
+//
+// A failed write or fdatasync() leaves it unknown which rows reached the
+// disk: a later successful sync would not cover pages the kernel already
+// dropped. So every commit fails from then on, until open_db() starts
+// over from what the files hold.
+static Durability durability = DURABILITY_GROUP;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_flushed = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t log_changed = PTHREAD_COND_INITIALIZER; // Wakes the flusher
+static LogBuffer row_log;
+static LogBuffer heap_log;
+static LogBuffer row_flush;  // The group being written
+static LogBuffer heap_flush;
+static size_t log_events;    // Events staged since the last group was taken
+static struct timespec log_started;
+static uint64_t log_staged;    // Events staged since the database was opened
+static uint64_t log_committed; // Of those, events known to be written
+static int log_flushing;
+static int log_failed;
+static pthread_t flusher;
+static int flusher_running;
+static int flusher_stopping;
+
+// Records `row` as a child of each of its distinct parents.
+static int index_children(Table* table, const Event* e, uint32_t row) {
+    for (uint32_t i = 0; i < e->parent_count; i++) {
+        uint32_t parent = event_parent(e, i);
+        int seen = 0;
+        for (uint32_t j = 0; j < i && !seen; j++) {
+            if (event_parent(e, j) == parent) seen = 1;
+        }
+        if (!seen && !child_index_add(&table->children, parent, row)) return 0;
+    }
+    return 1;
+}
+
+// Identifies a row's content, so that a saved text index can tell whether
+// the rows it covers are still the same.
+static uint32_t row_check(const Table* table, size_t row) {
+    return crc32c(table->data[row], table->data_lengths[row]) ^ table->ids[row];
+}
+
+static int rebuild_text_index(Table* table) {
+    text_index_free(&table->text);
+    for (size_t row = 0; row < table->num_events; row++) {
+        uint32_t indexed;
+        if (!id_index_get(&table->id_index, table->ids[row], &indexed) || indexed != row) continue;
+        if (!text_index_add(&table->text, (uint32_t)row, table->data[row], table->data_lengths[row])) {
+            text_index_free(&table->text);
+            table->text.stale = 1;
+            return 0;
+        }
+    }
+    return 1;
+}
 
 Table* load_table(const char* filename) {
+    return load_table_with_stats(filename, NULL);
+}
+
+Table* load_table_with_stats(const char* filename, LoadStats* stats) {
     open_db(filename);
-    Table* table = malloc(sizeof(Table));
-    table->num_events = 0;
+    Table* table = new_table();
+    if (!table) {
+        perror("malloc");
+        exit(1);
+    }
+
+    LoadStats local = {0};
+    if (!stats) stats = &local;
+    stats->bytes_read = 0;
+    stats->rows_read = 0;
+    stats->torn_bytes = 0;
+    stats->corrupt_rows = 0;
 
-    Event e;
-    size_t i = 0;
-    while (read_event_by_id(i + 1, &e)) {
-        Event* dest = event_slot(table, table->num_events);
-        *dest = e;
-        table->num_events++;
+    // Both files are read in place from read-only mappings. Loaded events
+    // keep pointing into the heap's, which every table loaded from this
+    // database shares; the rows' mapping is only needed while loading.
+    fseek(heap_file, 0, SEEK_END);
+    size_t heap_size = (size_t)ftell(heap_file);
+    fseek(db_file, 0, SEEK_END);
+    size_t rows_size = (size_t)ftell(db_file) - FILE_HEADER_SIZE;
+    table->mapped_heap = mapped_open(fileno(heap_file), heap_size);
+    MappedFile* mapped_rows = mapped_open(fileno(db_file), FILE_HEADER_SIZE + rows_size);
+    if (!table->mapped_heap || !mapped_rows) exit(1);
+    const char* heap = table->mapped_heap->base;
+    const uint8_t* rows = (const uint8_t*)mapped_rows->base + FILE_HEADER_SIZE;
+    size_t heap_valid_end = 0;
+    uint32_t more_parents[MAX_PARENTS];
+
+    // Rows the saved text index already covers are not indexed again.
+    uint32_t text_rows = 0;
+    uint32_t text_check = 0;
+    if (!text_index_load(&table->text, text_index_name, &text_rows, &text_check)) text_rows = 0;
 
-        i++;
+    size_t whole_rows = rows_size / ROW_SIZE;
+    if (!table_reserve(table, whole_rows, 0) || !id_index_reserve(&table->id_index, whole_rows)) {
+        perror("malloc");
+        exit(1);
+    }
+    size_t valid_end = 0;    // End of the last intact row, relative to the first row
+    size_t invalid_run = 0;  // Damaged rows seen since then
+    for (size_t offset = 0; offset + ROW_SIZE <= rows_size; offset += ROW_SIZE) {
+        const uint8_t* record = rows + offset;
+        if (!record_valid(record) || !record_heap_valid(record, heap, heap_size)) {
+            invalid_run++;
+            continue;
+        }
+        // Damaged rows followed by intact ones are corruption, not a
+        // torn tail; they are skipped and reported.
+        stats->corrupt_rows += invalid_run;
+        invalid_run = 0;
+        valid_end = offset + ROW_SIZE;
+
+        Event e;
+        deserialize_event(record, heap, more_parents, &e);
+        size_t entry_end = (size_t)record_heap_offset(record) + heap_entry_size(&e);
+        if (entry_end > heap_valid_end) heap_valid_end = entry_end;
+        uint32_t row = (uint32_t)table->num_events;
+        if (!table_append(table, &e)) {
+            perror("malloc");
+            exit(1);
+        }
+        // Files written before duplicate ids were rejected may repeat an
+        // id; the first occurrence stays the indexed one.
+        if (!id_index_get(&table->id_index, e.id, NULL)) {
+            id_index_put(&table->id_index, e.id, row);
+            if (!index_children(table, &e, row)) {
+                perror("malloc");
+                exit(1);
+            }
+            if (row >= text_rows && !table->text.stale &&
+                !text_index_add(&table->text, row, e.data, e.data_length)) {
+                table->text.stale = 1;
+            }
+        }
+        stats->rows_read++;
+    }
+    mapped_release(mapped_rows);
+
+    // A partial row, and any damaged rows after the last intact one, are
+    // the remains of an interrupted write. Cut them off so new rows stay
+    // aligned.
+    stats->torn_bytes = rows_size - valid_end;
+    stats->bytes_read = valid_end;
+    if (stats->torn_bytes > 0 &&
+        ftruncate(fileno(db_file), (off_t)(FILE_HEADER_SIZE + valid_end)) != 0) {
+        perror("ftruncate");
+    }
+    // Likewise payloads whose rows never made it to disk.
+    if (heap_size > heap_valid_end) {
+        stats->torn_bytes += heap_size - heap_valid_end;
+        if (ftruncate(fileno(heap_file), (off_t)heap_valid_end) != 0) perror("ftruncate");
+    }
+    heap_end = heap_valid_end;
+
+    if (!reach_rebuild(table)) {
+        perror("malloc");
+        exit(1);
+    }
+
+    // A saved index that covers rows no longer in the file, or different
+    // ones, is rebuilt. Either way the saved copy is brought up to date.
+    if (text_rows > table->num_events || (text_rows > 0 && row_check(table, text_rows - 1) != text_check)) {
+        table->text.stale = 1;
+    }
+    if ((table->text.stale || text_rows < table->num_events) && !save_text_index(table)) {
+        fprintf(stderr, "Warning: could not save the text index to %s\n", text_index_name);
     }
     return table;
 }
 
+static int reserve_log(LogBuffer* log, size_t bytes) {
+    if (log->size + bytes <= log->capacity) return 1;
+    size_t capacity = log->capacity ? log->capacity : LOG_GROUP_MAX_BYTES;
+    while (capacity < log->size + bytes) capacity *= 2;
+    uint8_t* grown = realloc(log->data, capacity);
+    if (!grown) return 0;
+    log->data = grown;
+    log->capacity = capacity;
+    return 1;
+}
+
+static double log_age_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - log_started.tv_sec) * 1000.0 + (now.tv_nsec - log_started.tv_nsec) / 1e6;
+}
+
+static int write_log(FILE* file, LogBuffer* log) {
+    int fd = fileno(file);
+    size_t written = 0;
+    while (written < log->size) {
+        ssize_t n = write(fd, log->data + written, log->size - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("write");
+            return 0;
+        }
+        written += (size_t)n;
+    }
+    log->size = 0;
+
+    if (durability != DURABILITY_NONE && fdatasync(fd) != 0) {
+        perror("fdatasync");
+        return 0;
+    }
+    return 1;
+}
+
+// Moves what `src` holds to the end of `dest`.
+static int append_log(LogBuffer* dest, LogBuffer* src) {
+    if (dest->size == 0) {
+        LogBuffer swapped = *dest;
+        *dest = *src;
+        *src = swapped;
+        return 1;
+    }
+    if (!reserve_log(dest, src->size)) return 0;
+    memcpy(dest->data + dest->size, src->data, src->size);
+    dest->size += src->size;
+    src->size = 0;
+    return 1;
+}
+
+// Writes out everything staged so far as one group. Called with log_lock
+// held and no group being written; the lock is released during the I/O.
+static int flush_group() {
+    if (log_failed || !append_log(&heap_flush, &heap_log) || !append_log(&row_flush, &row_log)) return 0;
+    uint64_t target = log_staged;
+    log_events = 0;
+    log_flushing = 1;
+    pthread_mutex_unlock(&log_lock);
+
+    // Payloads go out first, so that no row on disk points past the end of
+    // the heap.
+    int ok = write_log(heap_file, &heap_flush) && write_log(db_file, &row_flush);
+
+    pthread_mutex_lock(&log_lock);
+    log_flushing = 0;
+    if (ok) {
+        log_committed = target;
+    } else {
+        log_failed = 1;
+    }
+    pthread_cond_broadcast(&log_flushed);
+    pthread_cond_signal(&log_changed);
+    return ok;
+}
+
+int commit_log() {
+    pthread_mutex_lock(&log_lock);
+    uint64_t target = log_staged;
+    int ok = !log_failed;
+    while (ok && log_committed < target) {
+        if (log_flushing) {
+            pthread_cond_wait(&log_flushed, &log_lock);
+        } else {
+            ok = flush_group();
+        }
+    }
+    pthread_mutex_unlock(&log_lock);
+    return ok;
+}
+
+// Serializes `e` and its heap entry straight into the log buffers. Space
+// must be reserved and log_lock held.
+static void stage_event(Event* e) {
+    if (log_events == 0) {
+        // A new group: the flusher starts timing it.
+        clock_gettime(CLOCK_MONOTONIC, &log_started);
+        pthread_cond_signal(&log_changed);
+    }
+    char* entry = (char*)heap_log.data + heap_log.size;
+    serialize_heap_entry(e, entry);
+    serialize_event(e, heap_end, entry, row_log.data + row_log.size);
+    row_log.size += ROW_SIZE;
+    heap_log.size += heap_entry_size(e);
+    heap_end += heap_entry_size(e);
+    log_events++;
+    log_staged++;
+}
+
+static int log_group_full() {
+    return log_events >= LOG_GROUP_MAX_EVENTS || row_log.size + heap_log.size >= LOG_GROUP_MAX_BYTES;
+}
+
+static int log_group_due() {
+    return log_events > 0 && (log_group_full() || log_age_ms() >= LOG_GROUP_WINDOW_MS);
+}
+
+static struct timespec deadline_after(double ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    long ns = deadline.tv_nsec + (long)(ms * 1e6);
+    deadline.tv_sec += ns / 1000000000L;
+    deadline.tv_nsec = ns % 1000000000L;
+    return deadline;
+}
+
+// Commits groups that no caller is waiting for once they are full or
+// LOG_GROUP_WINDOW_MS old. It stops committing after a failed write.
+static void* run_flusher(void* unused) {
+    (void)unused;
+    pthread_mutex_lock(&log_lock);
+    while (!flusher_stopping) {
+        if (log_events == 0 || log_flushing || log_failed) {
+            pthread_cond_wait(&log_changed, &log_lock);
+        } else if (!log_group_due()) {
+            struct timespec deadline = deadline_after(LOG_GROUP_WINDOW_MS - log_age_ms());
+            pthread_cond_timedwait(&log_changed, &log_lock, &deadline);
+        } else {
+            flush_group();
+        }
+    }
+    pthread_mutex_unlock(&log_lock);
+    return NULL;
+}
+
+static void start_flusher() {
+    flusher_stopping = 0;
+    flusher_running = pthread_create(&flusher, NULL, run_flusher, NULL) == 0;
+    if (!flusher_running) fprintf(stderr, "Warning: no background log flusher; groups are committed on insert\n");
+}
+
+static void stop_flusher() {
+    if (!flusher_running) return;
+    pthread_mutex_lock(&log_lock);
+    flusher_stopping = 1;
+    pthread_cond_signal(&log_changed);
+    pthread_mutex_unlock(&log_lock);
+    pthread_join(flusher, NULL);
+    flusher_running = 0;
+}
+
 void open_db(const char* filename) {
+    if (db_file) close_db();
+    char heap_name[4096];
+    heap_filename(filename, heap_name, sizeof(heap_name));
     db_file = fopen(filename, "a+b");
-    if (!db_file) {
+    heap_file = fopen(heap_name, "a+b");
+    if (!db_file || !heap_file) {
         perror("fopen");
         exit(1);
     }
+    // Two processes appending to the same files would interleave their
+    // rows and heap entries, so only one may have the database open.
+    if (flock(fileno(db_file), LOCK_EX | LOCK_NB) != 0) {
+        if (errno == EWOULDBLOCK) {
+            fprintf(stderr, "%s is already open in another process\n", filename);
+        } else {
+            perror("flock");
+        }
+        exit(1);
+    }
+    fseek(heap_file, 0, SEEK_END);
+    heap_end = (uint64_t)ftell(heap_file);
+    snprintf(text_index_name, sizeof(text_index_name), "%s" TEXT_INDEX_SUFFIX, filename);
+    // Anything still staged from before a failed write is dropped; the
+    // files are read back instead.
+    row_log.size = heap_log.size = row_flush.size = heap_flush.size = 0;
+    log_events = 0;
+    log_staged = log_committed = 0;
+    log_failed = 0;
+    start_flusher();
+
+    uint8_t header[FILE_HEADER_SIZE];
+    fseek(db_file, 0, SEEK_SET);
+    size_t n = fread(header, 1, FILE_HEADER_SIZE, db_file);
+    if (n == 0) {
+        // New database: stamp it with the current format.
+        write_file_header(header);
+        if (fwrite(header, FILE_HEADER_SIZE, 1, db_file) != 1 || fflush(db_file) != 0 ||
+            fdatasync(fileno(db_file)) != 0) {
+            perror("write");
+            exit(1);
+        }
+        return;
+    }
+
+    uint32_t version;
+    if (n < FILE_HEADER_SIZE || !read_file_header(header, &version)) {
+        fprintf(stderr, "%s is not in the CausalDB %d format; convert it with: build/migrate %s\n",
+                filename, FORMAT_VERSION, filename);
+        exit(1);
+    }
+    if (version != FORMAT_VERSION) {
+        fprintf(stderr, "%s uses format version %u, expected %d; convert it with: build/migrate %s\n",
+                filename, version, FORMAT_VERSION, filename);
+        exit(1);
+    }
 }
 
 void close_db() {
+    if (!db_file) return;
+    stop_flusher();
+    commit_log();
     fclose(db_file);
+    fclose(heap_file);
+    db_file = NULL;
+    heap_file = NULL;
 }
 
-void insert_event(Event* e, Table* table) {
-    if (table->num_events >= TABLE_MAX_EVENTS) {
-        printf("Error: table full.\n");
-        return;
+void set_durability(Durability mode) {
+    durability = mode;
+}
+
+int parse_durability(const char* name, Durability* out) {
+    if (strcmp(name, "none") == 0) {
+        *out = DURABILITY_NONE;
+    } else if (strcmp(name, "group") == 0) {
+        *out = DURABILITY_GROUP;
+    } else if (strcmp(name, "full") == 0) {
+        *out = DURABILITY_FULL;
+    } else {
+        return 0;
     }
+    return 1;
+}
 
-    table->events[table->num_events++] = *e;
+// Hands a group that just became full to the flusher and releases
+// log_lock. Unless `deferred`, commits the group here instead when the
+// mode wants every insert on disk or there is no flusher.
+static InsertResult finish_staging(int deferred) {
+    int full = log_group_full();
+    if (full) pthread_cond_signal(&log_changed);
+    pthread_mutex_unlock(&log_lock);
+    if (!deferred && (durability == DURABILITY_FULL || (!flusher_running && full))) {
+        return commit_log() ? INSERT_SUCCESS : INSERT_IO_ERROR;
+    }
+    return INSERT_SUCCESS;
+}
 
-    uint8_t buffer[ROW_SIZE];
-    serialize_event(e, buffer);
-    fseek(db_file, 0, SEEK_END);
-    fwrite(buffer, ROW_SIZE, 1, db_file);
-    fflush(db_file);
+static InsertResult check_event(const Event* e) {
+    if (e->data_length > MAX_DATA_LENGTH) return INSERT_DATA_TOO_LONG;
+    if (e->parent_count > MAX_PARENTS) return INSERT_TOO_MANY_PARENTS;
+    return INSERT_SUCCESS;
 }
 
-int read_event_by_id(uint32_t id, Event* out) {
-    fseek(db_file, 0, SEEK_SET);
-    uint8_t buffer[ROW_SIZE];
-    while (fread(buffer, ROW_SIZE, 1, db_file)) {
-        deserialize_event(buffer, out);
-        if (out->id == id) return 1;
+// What a group of events needs beyond one row each.
+typedef struct {
+    size_t edges;          // Parent links
+    size_t overflow;       // Parents beyond the inline ones, logged to the heap
+    size_t payload_bytes;  // Data, terminators included
+} EventSizes;
+
+static void add_event_sizes(EventSizes* sizes, const Event* e) {
+    sizes->edges += e->parent_count;
+    sizes->overflow += event_overflow_count(e);
+    sizes->payload_bytes += e->data_length + 1;
+}
+
+// Reserves everything `count` new events need, so that applying them can
+// never leave the in-memory indexes half-updated.
+static int reserve_events(Table* table, size_t count, const EventSizes* sizes, int logged) {
+    size_t overflow_bytes = sizes->overflow * sizeof(uint32_t);
+    return table_reserve(table, table->num_events + count, table->num_parents + sizes->edges) &&
+           child_index_reserve(&table->children, sizes->edges, sizes->edges) &&
+           id_index_reserve(&table->id_index, table->id_index.count + count) &&
+           reach_index_reserve(&table->reach, table->num_events + count) &&
+           blob_heap_reserve(&table->heap, sizes->payload_bytes) &&
+           (!logged || (reserve_log(&row_log, count * ROW_SIZE) &&
+                        reserve_log(&heap_log, sizes->payload_bytes + overflow_bytes)));
+}
+
+static void apply_event(Table* table, Event* e, int logged) {
+    uint32_t row = (uint32_t)table->num_events;
+    char* data = blob_heap_alloc(&table->heap, e->data_length + 1);
+    memcpy(data, e->data, e->data_length);
+    data[e->data_length] = '\0';
+    Event stored = *e;
+    stored.data = data;
+    table_append(table, &stored);
+    id_index_put(&table->id_index, e->id, row);
+    index_children(table, &stored, row);
+    // The text index is not reserved ahead; if it runs out of memory it is
+    // rebuilt on the next search instead.
+    if (!table->text.stale && !text_index_add(&table->text, row, data, e->data_length)) {
+        table->text.stale = 1;
+    }
+
+    // Labels stay valid as long as events arrive after their parents. An
+    // event that already has children invalidates them until the next
+    // rebuild, and so does running out of memory for a label.
+    if (child_index_list(&table->children, e->id) ||
+        (!table->reach.stale && !reach_label_row(table, row))) {
+        table->reach.stale = 1;
     }
-    return 0;
+
+    if (logged) stage_event(&stored);
 }
 
-int find_event_in_memory(uint32_t id, Table* table, Event* out) {
-    for (size_t i = 0; i < table->num_events; i++) {
-        if (table->events[i].id == id) {
-            *out = table->events[i];
-            return 1;
+InsertResult insert_event(Event* e, Table* table) {
+    if (id_index_get(&table->id_index, e->id, NULL)) {
+        return INSERT_DUPLICATE_ID;
+    }
+    InsertResult result = check_event(e);
+    if (result != INSERT_SUCCESS) return result;
+
+    EventSizes sizes = {0};
+    add_event_sizes(&sizes, e);
+    pthread_mutex_lock(&log_lock);
+    if (!reserve_events(table, 1, &sizes, 1)) {
+        pthread_mutex_unlock(&log_lock);
+        return INSERT_OUT_OF_MEMORY;
+    }
+
+    apply_event(table, e, 1);
+    return finish_staging(0);
+}
+
+// Applies a batch and, if `logged`, stages it; finish_staging() decides
+// whether to commit it.
+static InsertResult add_events(Event* batch, size_t n, Table* table, int logged, int deferred) {
+    // Validate the whole batch first so that it is applied all or nothing.
+    IdIndex seen;
+    id_index_init(&seen);
+    EventSizes sizes = {0};
+    InsertResult result = INSERT_SUCCESS;
+    if (!id_index_reserve(&seen, n)) result = INSERT_OUT_OF_MEMORY;
+
+    for (size_t i = 0; i < n && result == INSERT_SUCCESS; i++) {
+        if (id_index_get(&table->id_index, batch[i].id, NULL) || id_index_get(&seen, batch[i].id, NULL)) {
+            result = INSERT_DUPLICATE_ID;
+        } else if ((result = check_event(&batch[i])) == INSERT_SUCCESS) {
+            id_index_put(&seen, batch[i].id, (uint32_t)i);
+            add_event_sizes(&sizes, &batch[i]);
         }
     }
-    return 0;
+    id_index_free(&seen);
+    if (result != INSERT_SUCCESS) return result;
+
+    if (logged) pthread_mutex_lock(&log_lock);
+    if (!reserve_events(table, n, &sizes, logged)) {
+        if (logged) pthread_mutex_unlock(&log_lock);
+        return INSERT_OUT_OF_MEMORY;
+    }
+
+    // The rows land contiguously in the log buffers and go out in one
+    // group, a single write per file, each followed by at most one
+    // fdatasync.
+    for (size_t i = 0; i < n; i++) {
+        apply_event(table, &batch[i], logged);
+    }
+    if (!logged) return INSERT_SUCCESS;
+    return finish_staging(deferred);
+}
+
+InsertResult insert_events(Event* batch, size_t n, Table* table) {
+    return add_events(batch, n, table, 1, 0);
+}
+
+InsertResult stage_events(Event* batch, size_t n, Table* table) {
+    return add_events(batch, n, table, 1, 1);
+}
+
+InsertResult replay_events(Event* batch, size_t n, Table* table) {
+    return add_events(batch, n, table, 0, 0);
+}
+
+int lookup_row(uint32_t id, Table* table, uint32_t* row) {
+    return id_index_get(&table->id_index, id, row);
+}
+
+int is_served_row(Table* table, uint32_t row) {
+    uint32_t indexed;
+    return lookup_row(table->ids[row], table, &indexed) && indexed == row;
+}
+
+int search_events(Table* table, const char* query, size_t length, Traversal* out) {
+    out->truncated = 0;
+    if (table->text.stale && !rebuild_text_index(table)) {
+        out->rows = NULL;
+        out->count = 0;
+        return 0;
+    }
+    return text_index_search(&table->text, query, length, &out->rows, &out->count);
+}
+
+int refresh_indexes(Table* table) {
+    return (!table->reach.stale || reach_rebuild(table)) && (!table->text.stale || rebuild_text_index(table));
+}
+
+int save_text_index(Table* table) {
+    if (table->text.stale && !rebuild_text_index(table)) return 0;
+    // The saved index must not cover rows that are not in the file yet.
+    if (!commit_log()) return 0;
+    uint32_t rows = (uint32_t)table->num_events;
+    return text_index_save(&table->text, text_index_name, rows, rows > 0 ? row_check(table, rows - 1) : 0);
+}
+
+int find_event_in_memory(uint32_t id, Table* table, Event* out) {
+    uint32_t row;
+    if (table->id_index.capacity > 0) {
+        if (!lookup_row(id, table, &row)) return 0;
+    } else {
+        // A table built without an id index is searched column-wise.
+        size_t found = scan_u32(table->ids, table->num_events, id);
+        if (found == table->num_events) return 0;
+        row = (uint32_t)found;
+    }
+    table_event(table, row, out);
+    return 1;
 }
@@ -1,17 +1,250 @@
+#define _POSIX_C_SOURCE 200809L
 #include "event.h"
+#include "crc32c.h"
+#include "mapped.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-void serialize_event(Event* src, void* dest) {
-    memcpy(dest, &src->id, 4);
-    memcpy(dest + 4, &src->parent_count, 1);
-    memcpy(dest + 5, &src->parents, 4 * MAX_PARENTS);
-    memcpy(dest + 37, &src->data, MAX_DATA_LENGTH);
+void serialize_heap_entry(const Event* src, char* dest) {
+    uint8_t* p = (uint8_t*)dest;
+    for (uint32_t i = INLINE_PARENTS; i < src->parent_count; i++) {
+        store_le32(p, src->more_parents[i - INLINE_PARENTS]);
+        p += 4;
+    }
+    memcpy(p, src->data, src->data_length);
+    p[src->data_length] = '\0';
 }
 
-void deserialize_event(void* src, Event* dest) {
-    memcpy(&dest->id, src, 4);
-    memcpy(&dest->parent_count, src + 4, 1);
-    memcpy(&dest->parents, src + 5, 4 * MAX_PARENTS);
-    memcpy(&dest->data, src + 37, MAX_DATA_LENGTH);
+void serialize_event(const Event* src, uint64_t heap_offset, const char* entry, void* dest) {
+    uint8_t* record = dest;
+    memset(record, 0, ROW_SIZE);
+    store_le32(record + RECORD_ID_OFFSET, src->id);
+    record[RECORD_PARENT_COUNT_OFFSET] = (uint8_t)src->parent_count;
+    record[RECORD_PARENT_COUNT_OFFSET + 1] = (uint8_t)(src->parent_count >> 8);
+    record[RECORD_DATA_LENGTH_OFFSET] = (uint8_t)src->data_length;
+    record[RECORD_DATA_LENGTH_OFFSET + 1] = (uint8_t)(src->data_length >> 8);
+    store_le64(record + RECORD_HEAP_OFFSET, heap_offset);
+    for (uint32_t i = 0; i < src->parent_count && i < INLINE_PARENTS; i++) {
+        store_le32(record + RECORD_PARENTS_OFFSET + 4 * i, src->parents[i]);
+    }
+    store_le32(record + RECORD_HEAP_CRC_OFFSET, crc32c(entry, heap_entry_size(src) - 1));
+    store_le32(record + RECORD_CRC_OFFSET, crc32c(record, RECORD_CRC_OFFSET));
+}
+
+void deserialize_event(const void* src, const char* heap, uint32_t* more_parents, Event* dest) {
+    const uint8_t* record = src;
+    const char* entry = heap + record_heap_offset(record);
+    dest->id = record_id(record);
+    dest->parent_count = record_parent_count(record);
+    for (uint32_t i = 0; i < INLINE_PARENTS; i++) {
+        dest->parents[i] = record_parent(record, i);
+    }
+    uint32_t overflow = record_overflow_count(record);
+    for (uint32_t i = 0; i < overflow; i++) {
+        more_parents[i] = load_le32((const uint8_t*)entry + 4 * i);
+    }
+    dest->more_parents = overflow ? more_parents : NULL;
+    dest->data_length = record_data_length(record);
+    dest->data = record_entry_data(record, entry);
+}
+
+int record_valid(const uint8_t* record) {
+    return crc32c(record, RECORD_CRC_OFFSET) == load_le32(record + RECORD_CRC_OFFSET);
+}
+
+int record_heap_valid(const uint8_t* record, const char* heap, size_t heap_size) {
+    uint64_t offset = record_heap_offset(record);
+    if (record_parent_count(record) > MAX_PARENTS || record_data_length(record) > MAX_DATA_LENGTH) return 0;
+    size_t length = 4 * (size_t)record_overflow_count(record) + record_data_length(record);
+    if (offset >= heap_size || heap_size - offset <= length) return 0;
+    if (heap[offset + length] != '\0') return 0;
+    return crc32c(heap + offset, length) == load_le32(record + RECORD_HEAP_CRC_OFFSET);
+}
+
+void heap_filename(const char* filename, char* out, size_t out_size) {
+    snprintf(out, out_size, "%s" HEAP_SUFFIX, filename);
+}
+
+void write_file_header(uint8_t* dest) {
+    memset(dest, 0, FILE_HEADER_SIZE);
+    memcpy(dest, FORMAT_MAGIC, 8);
+    store_le32(dest + 8, FORMAT_VERSION);
+    store_le32(dest + 12, ROW_SIZE);
+    store_le32(dest + FILE_HEADER_CRC_OFFSET, crc32c(dest, FILE_HEADER_CRC_OFFSET));
+}
+
+int read_file_header(const uint8_t* header, uint32_t* version) {
+    if (memcmp(header, FORMAT_MAGIC, 8) != 0) return 0;
+    if (crc32c(header, FILE_HEADER_CRC_OFFSET) != load_le32(header + FILE_HEADER_CRC_OFFSET)) return 0;
+    *version = load_le32(header + 8);
+    return 1;
+}
+
+void blob_heap_init(BlobHeap* heap) {
+    heap->blocks = NULL;
+    heap->num_blocks = 0;
+    heap->max_blocks = 0;
+    heap->used = 0;
+    heap->capacity = 0;
+}
+
+void blob_heap_free(BlobHeap* heap) {
+    for (size_t i = 0; i < heap->num_blocks; i++) {
+        free(heap->blocks[i]);
+    }
+    free(heap->blocks);
+    blob_heap_init(heap);
+}
+
+int blob_heap_reserve(BlobHeap* heap, size_t bytes) {
+    if (heap->num_blocks > 0 && heap->capacity - heap->used >= bytes) return 1;
+
+    if (heap->num_blocks == heap->max_blocks) {
+        size_t max_blocks = heap->max_blocks ? heap->max_blocks * 2 : 8;
+        char** blocks = realloc(heap->blocks, max_blocks * sizeof(char*));
+        if (!blocks) return 0;
+        heap->blocks = blocks;
+        heap->max_blocks = max_blocks;
+    }
+
+    // Oversized requests get a block of their own; the unused tail of the
+    // previous block is abandoned.
+    size_t capacity = bytes > BLOB_BLOCK_SIZE ? bytes : BLOB_BLOCK_SIZE;
+    char* block = malloc(capacity);
+    if (!block) return 0;
+    heap->blocks[heap->num_blocks++] = block;
+    heap->used = 0;
+    heap->capacity = capacity;
+    return 1;
+}
+
+char* blob_heap_alloc(BlobHeap* heap, size_t bytes) {
+    if (!blob_heap_reserve(heap, bytes)) return NULL;
+    char* p = heap->blocks[heap->num_blocks - 1] + heap->used;
+    heap->used += bytes;
+    return p;
+}
+
+static const char* skip_separators(const char* p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == ',') p++;
+    return p;
+}
+
+char* parse_parent_list(const char* p, Event* e, BlobHeap* overflow) {
+    // Count first so that the overflow parents are allocated in one piece.
+    uint32_t count = 0;
+    char* end;
+    for (const char* q = skip_separators(p);; q = skip_separators(end)) {
+        strtoul(q, &end, 10);
+        if (end == q) break;
+        count++;
+    }
+
+    uint32_t* more = NULL;
+    if (count > INLINE_PARENTS) {
+        more = (uint32_t*)blob_heap_alloc(overflow, (count - INLINE_PARENTS) * sizeof(uint32_t));
+        if (!more) return NULL;
+    }
+    e->parent_count = count;
+    e->more_parents = more;
+
+    p = skip_separators(p);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t parent = (uint32_t)strtoul(p, &end, 10);
+        if (i < INLINE_PARENTS) {
+            e->parents[i] = parent;
+        } else {
+            more[i - INLINE_PARENTS] = parent;
+        }
+        p = skip_separators(end);
+    }
+    return (char*)p;
+}
+
+Table* new_table() {
+    Table* table = calloc(1, sizeof(Table));
+    if (!table) return NULL;
+    id_index_init(&table->id_index);
+    child_index_init(&table->children);
+    reach_index_init(&table->reach);
+    text_index_init(&table->text);
+    blob_heap_init(&table->heap);
+    return table;
+}
+
+void free_table(Table* table) {
+    if (!table) return;
+    free(table->ids);
+    free(table->parent_counts);
+    free(table->parent_offsets);
+    free(table->data_lengths);
+    free((void*)table->data);
+    free(table->parents);
+    id_index_free(&table->id_index);
+    child_index_free(&table->children);
+    reach_index_free(&table->reach);
+    text_index_free(&table->text);
+    blob_heap_free(&table->heap);
+    mapped_release(table->mapped_heap);
+    free(table);
+}
+
+static int grow_column(void** column, size_t capacity, size_t elem_size) {
+    void* grown = realloc(*column, capacity * elem_size);
+    if (!grown) return 0;
+    *column = grown;
+    return 1;
+}
+
+int table_reserve(Table* table, size_t rows, size_t parents) {
+    if (rows > table->capacity) {
+        size_t capacity = table->capacity ? table->capacity : TABLE_MIN_CAPACITY;
+        while (capacity < rows) capacity *= 2;
+        if (!grow_column((void**)&table->ids, capacity, sizeof(uint32_t)) ||
+            !grow_column((void**)&table->parent_counts, capacity, sizeof(uint32_t)) ||
+            !grow_column((void**)&table->parent_offsets, capacity, sizeof(uint32_t)) ||
+            !grow_column((void**)&table->data_lengths, capacity, sizeof(uint32_t)) ||
+            !grow_column((void**)&table->data, capacity, sizeof(const char*))) {
+            return 0;
+        }
+        table->capacity = capacity;
+    }
+
+    // Offsets into `parents` are 32-bit.
+    if (parents > UINT32_MAX) return 0;
+    if (parents > table->parents_capacity) {
+        size_t capacity = table->parents_capacity ? table->parents_capacity : TABLE_MIN_CAPACITY;
+        while (capacity < parents) capacity *= 2;
+        if (!grow_column((void**)&table->parents, capacity, sizeof(uint32_t))) return 0;
+        table->parents_capacity = capacity;
+    }
+    return 1;
+}
+
+int table_append(Table* table, const Event* e) {
+    if (!table_reserve(table, table->num_events + 1, table->num_parents + e->parent_count)) return 0;
+    size_t row = table->num_events++;
+    table->ids[row] = e->id;
+    table->parent_counts[row] = e->parent_count;
+    table->parent_offsets[row] = (uint32_t)table->num_parents;
+    table->data_lengths[row] = e->data_length;
+    table->data[row] = e->data;
+    for (uint32_t i = 0; i < e->parent_count; i++) {
+        table->parents[table->num_parents++] = event_parent(e, i);
+    }
+    return 1;
+}
+
+void table_event(const Table* table, size_t row, Event* out) {
+    const uint32_t* parents = table_parents(table, row);
+    out->id = table->ids[row];
+    out->parent_count = table->parent_counts[row];
+    for (uint32_t i = 0; i < INLINE_PARENTS && i < out->parent_count; i++) {
+        out->parents[i] = parents[i];
+    }
+    // The remaining parents follow the inline ones in the same list.
+    out->more_parents = out->parent_count > INLINE_PARENTS ? parents + INLINE_PARENTS : NULL;
+    out->data_length = table->data_lengths[row];
+    out->data = table->data[row];
 }
@@ -0,0 +1,256 @@
+#include "export.h"
+#include "crc32c.h"
+#include "db.h"
+#include "wire.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define EXPORT_WRITE_BLOCK 4096
+
+void write_export_header(uint8_t* dest) {
+    memset(dest, 0, EXPORT_HEADER_SIZE);
+    memcpy(dest, EXPORT_MAGIC, 8);
+    store_le32(dest + 8, FORMAT_VERSION);
+    store_le32(dest + 12, ROW_SIZE);
+    store_le32(dest + EXPORT_HEADER_CRC_OFFSET, crc32c(dest, EXPORT_HEADER_CRC_OFFSET));
+}
+
+int export_binary(Table* table, FILE* out) {
+    uint8_t header[EXPORT_HEADER_SIZE];
+    write_export_header(header);
+    if (fwrite(header, sizeof(header), 1, out) != 1) return 0;
+
+    Event* events = malloc(EXPORT_FRAME_EVENTS * sizeof(Event));
+    uint8_t* frame = NULL;
+    size_t frame_capacity = 0;
+    int ok = events != NULL;
+    uint32_t row = 0;
+    uint32_t end_row = (uint32_t)table->num_events;
+    while (ok) {
+        size_t count = 0;
+        while (row < end_row && count < EXPORT_FRAME_EVENTS) {
+            if (is_served_row(table, row)) table_event(table, row, &events[count++]);
+            row++;
+        }
+        // The closing frame is the only empty one
+        if (count == 0 && row < end_row) continue;
+
+        size_t size = wire_batch_size(events, count);
+        if (size > frame_capacity) {
+            uint8_t* grown = realloc(frame, size);
+            if (!grown) {
+                ok = 0;
+                break;
+            }
+            frame = grown;
+            frame_capacity = size;
+        }
+        wire_write_batch(frame, WIRE_EVENTS, 0, row, events, count);
+        ok = fwrite(frame, size, 1, out) == 1;
+        if (count == 0) break;
+    }
+    free(events);
+    free(frame);
+    return ok && fflush(out) == 0;
+}
+
+static int write_column32(FILE* out, const uint32_t* values, size_t n) {
+    uint8_t block[4 * EXPORT_WRITE_BLOCK];
+    for (size_t i = 0; i < n; i += EXPORT_WRITE_BLOCK) {
+        size_t count = n - i < EXPORT_WRITE_BLOCK ? n - i : EXPORT_WRITE_BLOCK;
+        for (size_t j = 0; j < count; j++) {
+            store_le32(block + 4 * j, values[i + j]);
+        }
+        if (fwrite(block, 4, count, out) != count) return 0;
+    }
+    return 1;
+}
+
+static int write_column64(FILE* out, const uint64_t* values, size_t n) {
+    uint8_t block[8 * EXPORT_WRITE_BLOCK];
+    for (size_t i = 0; i < n; i += EXPORT_WRITE_BLOCK) {
+        size_t count = n - i < EXPORT_WRITE_BLOCK ? n - i : EXPORT_WRITE_BLOCK;
+        for (size_t j = 0; j < count; j++) {
+            store_le64(block + 8 * j, values[i + j]);
+        }
+        if (fwrite(block, 8, count, out) != count) return 0;
+    }
+    return 1;
+}
+
+static int write_padding(FILE* out, uint64_t from, uint64_t to) {
+    static const uint8_t zeros[8];
+    return to == from || fwrite(zeros, (size_t)(to - from), 1, out) == 1;
+}
+
+static int grow_array(void** array, size_t* max, size_t needed, size_t elem_size) {
+    if (needed <= *max) return 1;
+    size_t capacity = *max ? *max : 64;
+    while (capacity < needed) capacity *= 2;
+    void* grown = realloc(*array, capacity * elem_size);
+    if (!grown) return 0;
+    *array = grown;
+    *max = capacity;
+    return 1;
+}
+
+static uint32_t zigzag(uint32_t from, uint32_t to) {
+    int32_t delta = (int32_t)(to - from);
+    return (uint32_t)delta << 1 ^ (uint32_t)(delta >> 31);
+}
+
+int columnar_begin(ColumnarExport* builder, uint32_t end_row) {
+    memset(builder, 0, sizeof(*builder));
+    builder->end_row = end_row;
+    builder->ids = malloc(((size_t)end_row + 1) * sizeof(uint32_t));
+    builder->codes = malloc(((size_t)end_row + 1) * sizeof(uint32_t));
+    builder->edge_offsets = malloc(((size_t)end_row + 1) * sizeof(uint64_t));
+    if (!builder->ids || !builder->codes || !builder->edge_offsets ||
+        !grow_array((void**)&builder->dict_offsets, &builder->max_codes, 1, sizeof(uint64_t))) {
+        return 0;
+    }
+    builder->edge_offsets[0] = 0;
+    builder->dict_offsets[0] = 0;
+    return 1;
+}
+
+void columnar_free(ColumnarExport* builder) {
+    free(builder->ids);
+    free(builder->codes);
+    free(builder->edge_offsets);
+    free(builder->edges);
+    free(builder->dict_offsets);
+    free(builder->dict);
+    free(builder->slots);
+    memset(builder, 0, sizeof(*builder));
+}
+
+// Doubles the payload hash table, keeping it at most half full.
+static int grow_slots(ColumnarExport* builder) {
+    size_t num_slots = builder->num_slots ? 2 * builder->num_slots : 16;
+    uint32_t* slots = calloc(num_slots, sizeof(uint32_t));
+    if (!slots) return 0;
+    for (size_t code = 0; code < builder->num_codes; code++) {
+        uint64_t start = builder->dict_offsets[code];
+        size_t slot = crc32c(builder->dict + start, (size_t)(builder->dict_offsets[code + 1] - start - 1)) &
+                      (num_slots - 1);
+        while (slots[slot] != 0) slot = (slot + 1) & (num_slots - 1);
+        slots[slot] = (uint32_t)code + 1;
+    }
+    free(builder->slots);
+    builder->slots = slots;
+    builder->num_slots = num_slots;
+    return 1;
+}
+
+// Sets `code` to the dictionary code of a payload, adding it to the
+// dictionary if it is new. Returns 0 if out of memory.
+static int payload_code(ColumnarExport* builder, const char* data, uint32_t length, uint32_t* code) {
+    if (2 * (builder->num_codes + 1) > builder->num_slots && !grow_slots(builder)) return 0;
+    size_t slot = crc32c(data, length) & (builder->num_slots - 1);
+    while (builder->slots[slot] != 0) {
+        uint32_t other = builder->slots[slot] - 1;
+        uint64_t start = builder->dict_offsets[other];
+        if (builder->dict_offsets[other + 1] - start - 1 == length &&
+            memcmp(builder->dict + start, data, length) == 0) {
+            *code = other;
+            return 1;
+        }
+        slot = (slot + 1) & (builder->num_slots - 1);
+    }
+
+    size_t size = (size_t)builder->dict_offsets[builder->num_codes];
+    if (!grow_array((void**)&builder->dict_offsets, &builder->max_codes, builder->num_codes + 2,
+                    sizeof(uint64_t)) ||
+        !grow_array((void**)&builder->dict, &builder->dict_capacity, size + length + 1, 1)) {
+        return 0;
+    }
+    memcpy(builder->dict + size, data, length);
+    builder->dict[size + length] = '\0';
+    builder->dict_offsets[builder->num_codes + 1] = size + length + 1;
+    *code = (uint32_t)builder->num_codes++;
+    builder->slots[slot] = *code + 1;
+    return 1;
+}
+
+int columnar_add_rows(ColumnarExport* builder, Table* table, uint32_t max_rows) {
+    uint32_t stop = builder->end_row - builder->next_row < max_rows ? builder->end_row : builder->next_row + max_rows;
+    for (; builder->next_row < stop; builder->next_row++) {
+        uint32_t row = builder->next_row;
+        if (!is_served_row(table, row)) continue;
+
+        // The parent count, then each parent relative to the one before
+        const uint32_t* parents = table_parents(table, row);
+        uint32_t num_parents = table->parent_counts[row];
+        size_t size = (size_t)builder->edge_offsets[builder->count];
+        if (!grow_array((void**)&builder->edges, &builder->edges_capacity,
+                        size + ((size_t)num_parents + 1) * VARINT_MAX_BYTES, 1)) {
+            return 0;
+        }
+        size += put_varint(builder->edges + size, num_parents);
+        uint32_t previous = table->ids[row];
+        for (uint32_t p = 0; p < num_parents; p++) {
+            size += put_varint(builder->edges + size, zigzag(previous, parents[p]));
+            previous = parents[p];
+        }
+
+        uint32_t code;
+        if (!payload_code(builder, table->data[row], table->data_lengths[row], &code)) return 0;
+        builder->ids[builder->count] = table->ids[row];
+        builder->codes[builder->count] = code;
+        builder->edge_offsets[++builder->count] = size;
+    }
+    return 1;
+}
+
+int columnar_write(const ColumnarExport* builder, FILE* out) {
+    size_t n = builder->count;
+    size_t num_codes = builder->num_codes;
+    uint64_t sizes[COLUMN_COUNT];
+    sizes[COLUMN_IDS] = 4 * (uint64_t)n;
+    sizes[COLUMN_EDGE_OFFSETS] = 8 * ((uint64_t)n + 1);
+    sizes[COLUMN_EDGES] = builder->edge_offsets[n];
+    sizes[COLUMN_PAYLOAD_CODES] = 4 * (uint64_t)n;
+    sizes[COLUMN_DICT_OFFSETS] = 8 * ((uint64_t)num_codes + 1);
+    sizes[COLUMN_DICT] = builder->dict_offsets[num_codes];
+
+    uint8_t header[COLUMNAR_HEADER_SIZE];
+    uint64_t offsets[COLUMN_COUNT];
+    uint64_t end = COLUMNAR_HEADER_SIZE;
+    memset(header, 0, sizeof(header));
+    memcpy(header, COLUMNAR_MAGIC, 8);
+    store_le32(header + 8, COLUMNAR_VERSION);
+    store_le32(header + 12, (uint32_t)n);
+    store_le32(header + 16, (uint32_t)num_codes);
+    for (int s = 0; s < COLUMN_COUNT; s++) {
+        offsets[s] = (end + 7) & ~(uint64_t)7;
+        end = offsets[s] + sizes[s];
+        store_le64(header + COLUMNAR_SECTIONS_OFFSET + 16 * s, offsets[s]);
+        store_le64(header + COLUMNAR_SECTIONS_OFFSET + 16 * s + 8, sizes[s]);
+    }
+    store_le32(header + COLUMNAR_HEADER_CRC_OFFSET, crc32c(header, COLUMNAR_HEADER_CRC_OFFSET));
+
+    int ok = fwrite(header, sizeof(header), 1, out) == 1 &&
+             write_padding(out, COLUMNAR_HEADER_SIZE, offsets[COLUMN_IDS]) &&
+             write_column32(out, builder->ids, n) &&
+             write_padding(out, offsets[COLUMN_IDS] + sizes[COLUMN_IDS], offsets[COLUMN_EDGE_OFFSETS]) &&
+             write_column64(out, builder->edge_offsets, n + 1) &&
+             (n == 0 || fwrite(builder->edges, (size_t)sizes[COLUMN_EDGES], 1, out) == 1) &&
+             write_padding(out, offsets[COLUMN_EDGES] + sizes[COLUMN_EDGES], offsets[COLUMN_PAYLOAD_CODES]) &&
+             write_column32(out, builder->codes, n) &&
+             write_padding(out, offsets[COLUMN_PAYLOAD_CODES] + sizes[COLUMN_PAYLOAD_CODES],
+                           offsets[COLUMN_DICT_OFFSETS]) &&
+             write_column64(out, builder->dict_offsets, num_codes + 1) &&
+             write_padding(out, offsets[COLUMN_DICT_OFFSETS] + sizes[COLUMN_DICT_OFFSETS], offsets[COLUMN_DICT]) &&
+             (num_codes == 0 || fwrite(builder->dict, (size_t)sizes[COLUMN_DICT], 1, out) == 1);
+    return ok && fflush(out) == 0;
+}
+
+int export_columnar(Table* table, FILE* out) {
+    ColumnarExport builder;
+    int ok = columnar_begin(&builder, (uint32_t)table->num_events) &&
+             columnar_add_rows(&builder, table, builder.end_row) &&
+             columnar_write(&builder, out);
+    columnar_free(&builder);
+    return ok;
+}
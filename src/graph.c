@@ -0,0 +1,537 @@
+#include "graph.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BITMAP_WORDS(n) (((n) + 63) / 64)
+
+static inline int test_and_set(uint64_t* bitmap, uint32_t row) {
+    uint64_t mask = (uint64_t)1 << (row & 63);
+    if (bitmap[row >> 6] & mask) return 1;
+    bitmap[row >> 6] |= mask;
+    return 0;
+}
+
+// Queue state for one breadth-first walk.
+typedef struct {
+    Table* table;
+    TraversalDirection direction;
+    uint32_t* queue;
+    uint64_t* visited;
+    size_t tail;
+    size_t limit;
+} Walk;
+
+static inline int visit(Walk* walk, uint32_t row) {
+    if (test_and_set(walk->visited, row)) return 1;
+    if (walk->limit && walk->tail == walk->limit) return 0;
+    walk->queue[walk->tail++] = row;
+    return 1;
+}
+
+// Enqueues the unvisited neighbours of `row`. Returns 0 once the result
+// limit has been reached.
+static int expand(Walk* walk, uint32_t row) {
+    Table* table = walk->table;
+
+    if (walk->direction == TRAVERSE_ANCESTORS) {
+        const uint32_t* parents = table_parents(table, row);
+        for (uint32_t i = 0; i < table->parent_counts[row]; i++) {
+            uint32_t parent;
+            if (id_index_get(&table->id_index, parents[i], &parent) && !visit(walk, parent)) return 0;
+        }
+    } else {
+        const ChildList* list = child_index_list(&table->children, table->ids[row]);
+        for (uint32_t edge = list ? list->head : EDGE_NONE; edge != EDGE_NONE;
+             edge = table->children.edges[edge].next) {
+            if (!visit(walk, table->children.edges[edge].child_row)) return 0;
+        }
+    }
+    return 1;
+}
+
+int traverse(Table* table, uint32_t id, TraversalDirection direction,
+             uint32_t max_depth, size_t limit, Traversal* out) {
+    out->rows = NULL;
+    out->count = 0;
+    out->truncated = 0;
+
+    uint32_t start;
+    if (!id_index_get(&table->id_index, id, &start)) return 0;
+
+    // The queue doubles as the result: every row is enqueued at most once,
+    // in BFS order, so the walk needs no per-node allocation.
+    size_t n = table->num_events;
+    Walk walk = { table, direction, NULL, NULL, 0, limit };
+    walk.queue = malloc(n * sizeof(uint32_t));
+    walk.visited = calloc(BITMAP_WORDS(n), sizeof(uint64_t));
+    if (!walk.queue || !walk.visited) {
+        free(walk.queue);
+        free(walk.visited);
+        return 0;
+    }
+    test_and_set(walk.visited, start);
+
+    int complete = expand(&walk, start);
+    size_t head = 0;
+    size_t level_end = walk.tail;
+    uint32_t depth = 1; // Depth of the rows in [head, level_end)
+
+    while (complete && head < walk.tail) {
+        if (head == level_end) {
+            depth++;
+            level_end = walk.tail;
+        }
+        if (max_depth && depth >= max_depth) break;
+        complete = expand(&walk, walk.queue[head++]);
+    }
+
+    free(walk.visited);
+    out->rows = walk.queue;
+    out->count = walk.tail;
+    out->truncated = !complete;
+    return 1;
+}
+
+void free_traversal(Traversal* traversal) {
+    free(traversal->rows);
+    traversal->rows = NULL;
+    traversal->count = 0;
+}
+
+int intersect_traversal(Table* table, Traversal* rows, const Traversal* within) {
+    uint64_t* reached = calloc(BITMAP_WORDS(table->num_events) + 1, sizeof(uint64_t));
+    if (!reached) return 0;
+    for (size_t i = 0; i < within->count; i++) {
+        test_and_set(reached, within->rows[i]);
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < rows->count; i++) {
+        if (test_and_set(reached, rows->rows[i])) rows->rows[kept++] = rows->rows[i];
+    }
+    rows->count = kept;
+    free(reached);
+    return 1;
+}
+
+// Returns 1 if `row` is the row the id index maps its event id to. Rows
+// shadowed by an earlier duplicate id take no part in the graph.
+static inline int is_indexed_row(Table* table, uint32_t row) {
+    uint32_t indexed;
+    return id_index_get(&table->id_index, table->ids[row], &indexed) && indexed == row;
+}
+
+// Returns 1 if the row's label covers all of its ancestors.
+static inline int has_label(ReachIndex* reach, uint32_t row) {
+    return reach->generation[row] != REACH_UNLABELED && reach->label_count[row] != REACH_PARTIAL;
+}
+
+// Returns 1 if `ancestor` is a proper ancestor of `row`; both must have
+// full labels.
+static int label_reaches(ReachIndex* reach, uint32_t row, uint32_t ancestor) {
+    uint32_t chain = reach->chain[ancestor];
+    if (reach->chain[row] == chain) return reach->position[ancestor] < reach->position[row];
+
+    const ReachEntry* entries = &reach->entries[reach->label_start[row]];
+    size_t low = 0;
+    size_t high = reach->label_count[row];
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (entries[mid].chain < chain) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low < reach->label_count[row] && entries[low].chain == chain &&
+           entries[low].position >= reach->position[ancestor];
+}
+
+static int compare_entries(const void* a, const void* b) {
+    const ReachEntry* x = a;
+    const ReachEntry* y = b;
+    if (x->chain != y->chain) return x->chain < y->chain ? -1 : 1;
+    if (x->position != y->position) return x->position > y->position ? -1 : 1;
+    return 0;
+}
+
+// Builds the label of a row with several parents, or one whose parent
+// already has a child on its chain, from its parents' labels and their
+// own places. Returns 0 if out of memory.
+static int merge_labels(Table* table, uint32_t row) {
+    ReachIndex* reach = &table->reach;
+    const uint32_t* parents = table_parents(table, row);
+    size_t needed = 0;
+    for (uint32_t i = 0; i < table->parent_counts[row]; i++) {
+        uint32_t parent;
+        if (!id_index_get(&table->id_index, parents[i], &parent)) continue;
+        if (reach->label_count[parent] == REACH_PARTIAL) {
+            reach->label_count[row] = REACH_PARTIAL;
+            return 1;
+        }
+        needed += reach->label_count[parent] + 1;
+    }
+    if (!reach_index_reserve_entries(reach, reach->num_entries + needed)) return 0;
+
+    // Gather every candidate past the end of the pool, then keep the
+    // furthest position per chain.
+    ReachEntry* merged = &reach->entries[reach->num_entries];
+    size_t count = 0;
+    for (uint32_t i = 0; i < table->parent_counts[row]; i++) {
+        uint32_t parent;
+        if (!id_index_get(&table->id_index, parents[i], &parent)) continue;
+        memcpy(&merged[count], &reach->entries[reach->label_start[parent]],
+               reach->label_count[parent] * sizeof(ReachEntry));
+        count += reach->label_count[parent];
+        merged[count].chain = reach->chain[parent];
+        merged[count].position = reach->position[parent];
+        count++;
+    }
+    qsort(merged, count, sizeof(ReachEntry), compare_entries);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (merged[i].chain == reach->chain[row]) continue;
+        if (kept > 0 && merged[kept - 1].chain == merged[i].chain) continue;
+        merged[kept++] = merged[i];
+    }
+    if (kept > REACH_MAX_LABEL) {
+        reach->label_count[row] = REACH_PARTIAL;
+        return 1;
+    }
+    reach->label_start[row] = reach->num_entries;
+    reach->label_count[row] = (uint32_t)kept;
+    reach->num_entries += kept;
+    return 1;
+}
+
+int reach_label_row(Table* table, uint32_t row) {
+    ReachIndex* reach = &table->reach;
+    const uint32_t* parents = table_parents(table, row);
+    uint32_t generation = 0;
+    uint32_t extended = REACH_UNLABELED; // Parent whose chain this row continues
+    uint32_t only_parent = REACH_UNLABELED;
+    int several = 0;
+
+    for (uint32_t i = 0; i < table->parent_counts[row]; i++) {
+        uint32_t parent;
+        if (!id_index_get(&table->id_index, parents[i], &parent)) continue;
+        if (reach->generation[parent] == REACH_UNLABELED) {
+            reach->generation[row] = REACH_UNLABELED;
+            return 1;
+        }
+
+        if (reach->generation[parent] + 1 > generation) generation = reach->generation[parent] + 1;
+        if (extended == REACH_UNLABELED &&
+            reach->position[parent] + 1 == reach->chain_lengths[reach->chain[parent]]) {
+            extended = parent;
+        }
+        if (only_parent != REACH_UNLABELED && only_parent != parent) several = 1;
+        only_parent = parent;
+    }
+    reach->generation[row] = generation;
+
+    if (extended != REACH_UNLABELED) {
+        reach->chain[row] = reach->chain[extended];
+        reach->position[row] = reach->position[extended] + 1;
+    } else {
+        reach->chain[row] = reach->num_chains++;
+        reach->position[row] = 0;
+    }
+    reach->chain_lengths[reach->chain[row]] = reach->position[row] + 1;
+
+    // A row continuing its only parent's chain has the same ancestors on
+    // other chains, so it shares the parent's label.
+    if (!several && extended != REACH_UNLABELED) {
+        reach->label_start[row] = reach->label_start[extended];
+        reach->label_count[row] = reach->label_count[extended];
+        return 1;
+    }
+    if (only_parent == REACH_UNLABELED) {
+        reach->label_start[row] = reach->num_entries;
+        reach->label_count[row] = 0;
+        return 1;
+    }
+    return merge_labels(table, row);
+}
+
+int reach_rebuild(Table* table) {
+    ReachIndex* reach = &table->reach;
+    size_t n = table->num_events;
+    if (!reach_index_reserve(reach, n)) return 0;
+
+    // Kahn's algorithm: a row is labeled once all of its parents are.
+    uint32_t* pending = calloc(n ? n : 1, sizeof(uint32_t));
+    uint32_t* queue = malloc((n ? n : 1) * sizeof(uint32_t));
+    if (!pending || !queue) {
+        free(pending);
+        free(queue);
+        return 0;
+    }
+
+    size_t tail = 0;
+    reach->num_chains = 0;
+    reach->num_entries = 0;
+    for (uint32_t row = 0; row < n; row++) {
+        reach->generation[row] = REACH_UNLABELED;
+        if (!is_indexed_row(table, row)) continue;
+
+        const uint32_t* parents = table_parents(table, row);
+        for (uint32_t i = 0; i < table->parent_counts[row]; i++) {
+            int seen = 0;
+            for (uint32_t j = 0; j < i && !seen; j++) {
+                if (parents[j] == parents[i]) seen = 1;
+            }
+            if (!seen && id_index_get(&table->id_index, parents[i], NULL)) pending[row]++;
+        }
+        if (pending[row] == 0) queue[tail++] = row;
+    }
+
+    int ok = 1;
+    for (size_t head = 0; ok && head < tail; head++) {
+        uint32_t row = queue[head];
+        ok = reach_label_row(table, row);
+
+        const ChildList* list = child_index_list(&table->children, table->ids[row]);
+        for (uint32_t edge = list ? list->head : EDGE_NONE; edge != EDGE_NONE;
+             edge = table->children.edges[edge].next) {
+            uint32_t child = table->children.edges[edge].child_row;
+            if (--pending[child] == 0) queue[tail++] = child;
+        }
+    }
+
+    free(pending);
+    free(queue);
+    reach->stale = !ok;
+    return ok;
+}
+
+int precedes(Table* table, uint32_t a, uint32_t b, int* result) {
+    *result = 0;
+    uint32_t a_row, b_row;
+    if (!id_index_get(&table->id_index, a, &a_row) || !id_index_get(&table->id_index, b, &b_row)) return 1;
+    if (a_row == b_row) return 1;
+
+    ReachIndex* reach = &table->reach;
+    if (reach->stale && !reach_rebuild(table)) return 0;
+
+    uint32_t a_generation = reach->generation[a_row];
+    int generations = a_generation != REACH_UNLABELED && reach->generation[b_row] != REACH_UNLABELED;
+    if (generations && a_generation >= reach->generation[b_row]) return 1;
+    if (has_label(reach, b_row)) {
+        *result = has_label(reach, a_row) && label_reaches(reach, b_row, a_row);
+        return 1;
+    }
+
+    // `b` lies on a cycle or below an oversized label. Search from it
+    // towards the roots, answering from the labels as soon as the search
+    // reaches a fully labeled row. Labeled rows never descend from
+    // unlabeled ones, so those are skipped when `a` is unlabeled.
+    IdIndex visited;
+    id_index_init(&visited);
+    size_t stack_size = 0;
+    size_t stack_capacity = 64;
+    uint32_t* stack = malloc(stack_capacity * sizeof(uint32_t));
+    int ok = stack != NULL;
+    int found = 0;
+    if (ok) stack[stack_size++] = b_row;
+
+    while (ok && stack_size > 0 && !found) {
+        uint32_t row = stack[--stack_size];
+        const uint32_t* parents = table_parents(table, row);
+        for (uint32_t i = 0; i < table->parent_counts[row]; i++) {
+            uint32_t parent;
+            if (!id_index_get(&table->id_index, parents[i], &parent)) continue;
+            if (parent == a_row) {
+                found = 1;
+                break;
+            }
+            uint32_t generation = reach->generation[parent];
+            if (generation != REACH_UNLABELED && (a_generation == REACH_UNLABELED || generation <= a_generation)) {
+                continue;
+            }
+            if (has_label(reach, parent)) {
+                if (has_label(reach, a_row) && label_reaches(reach, parent, a_row)) {
+                    found = 1;
+                    break;
+                }
+                continue;
+            }
+            if (id_index_get(&visited, parent, NULL)) continue;
+
+            if (stack_size == stack_capacity) {
+                uint32_t* grown = realloc(stack, stack_capacity * 2 * sizeof(uint32_t));
+                if (!grown) {
+                    ok = 0;
+                    break;
+                }
+                stack = grown;
+                stack_capacity *= 2;
+            }
+            if (!id_index_put(&visited, parent, 0)) {
+                ok = 0;
+                break;
+            }
+            stack[stack_size++] = parent;
+        }
+    }
+
+    free(stack);
+    id_index_free(&visited);
+    *result = found;
+    return ok || found;
+}
+
+#define PAINT_A 1
+#define PAINT_B 2
+#define PAINT_STALE 4
+#define PAINT_QUEUED 8
+
+// Max-heap of rows keyed by generation, so descendants are always
+// processed before their ancestors.
+typedef struct {
+    uint32_t* rows;
+    size_t size;
+    size_t capacity;
+    const uint32_t* generation;
+} RowHeap;
+
+static int heap_push(RowHeap* heap, uint32_t row) {
+    if (heap->size == heap->capacity) {
+        size_t capacity = heap->capacity ? heap->capacity * 2 : 64;
+        uint32_t* rows = realloc(heap->rows, capacity * sizeof(uint32_t));
+        if (!rows) return 0;
+        heap->rows = rows;
+        heap->capacity = capacity;
+    }
+
+    size_t i = heap->size++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (heap->generation[heap->rows[parent]] >= heap->generation[row]) break;
+        heap->rows[i] = heap->rows[parent];
+        i = parent;
+    }
+    heap->rows[i] = row;
+    return 1;
+}
+
+static uint32_t heap_pop(RowHeap* heap) {
+    uint32_t top = heap->rows[0];
+    uint32_t last = heap->rows[--heap->size];
+    size_t i = 0;
+    while (1) {
+        size_t child = 2 * i + 1;
+        if (child >= heap->size) break;
+        if (child + 1 < heap->size &&
+            heap->generation[heap->rows[child + 1]] > heap->generation[heap->rows[child]]) {
+            child++;
+        }
+        if (heap->generation[heap->rows[child]] <= heap->generation[last]) break;
+        heap->rows[i] = heap->rows[child];
+        i = child;
+    }
+    if (heap->size > 0) heap->rows[i] = last;
+    return top;
+}
+
+static inline uint32_t paint_of(IdIndex* paint, uint32_t row) {
+    uint32_t flags = 0;
+    id_index_get(paint, row, &flags);
+    return flags;
+}
+
+// Adds `flags` to a row's paint and queues the row unless it already is.
+// `fresh` counts the queued rows not painted stale, so the walk can tell
+// when only stale rows remain without scanning the heap.
+static int paint_row(IdIndex* paint, RowHeap* heap, size_t* fresh, uint32_t row, uint32_t flags) {
+    uint32_t old = paint_of(paint, row);
+    uint32_t painted = old | flags | PAINT_QUEUED;
+    if (!id_index_put(paint, row, painted)) return 0;
+    if (old & PAINT_QUEUED) {
+        if (!(old & PAINT_STALE) && (painted & PAINT_STALE)) (*fresh)--;
+        return 1;
+    }
+    if (!(painted & PAINT_STALE)) (*fresh)++;
+    return heap_push(heap, row);
+}
+
+int common_ancestors(Table* table, uint32_t a, uint32_t b, Traversal* out) {
+    out->rows = NULL;
+    out->count = 0;
+    out->truncated = 0;
+
+    uint32_t a_row, b_row;
+    if (!id_index_get(&table->id_index, a, &a_row) || !id_index_get(&table->id_index, b, &b_row)) return 0;
+    if (table->reach.stale && !reach_rebuild(table)) return 0;
+
+    size_t capacity = 8;
+    out->rows = malloc(capacity * sizeof(uint32_t));
+    if (!out->rows) return 0;
+    if (a_row == b_row) {
+        out->rows[out->count++] = a_row;
+        return 1;
+    }
+
+    // Paint everything reachable from `a` and from `b`, newest generation
+    // first. A row carrying both colours is a common ancestor; its own
+    // ancestors are marked stale so the walk stops as soon as every
+    // remaining candidate lies below an answer already found.
+    IdIndex paint;
+    id_index_init(&paint);
+    RowHeap heap = { NULL, 0, 0, table->reach.generation };
+    size_t fresh = 0;
+    int ok = paint_row(&paint, &heap, &fresh, a_row, PAINT_A) && paint_row(&paint, &heap, &fresh, b_row, PAINT_B);
+
+    while (ok && fresh > 0) {
+        uint32_t row = heap_pop(&heap);
+        uint32_t flags = paint_of(&paint, row) & ~PAINT_QUEUED;
+        if (!(flags & PAINT_STALE)) fresh--;
+
+        if ((flags & (PAINT_A | PAINT_B | PAINT_STALE)) == (PAINT_A | PAINT_B)) {
+            if (out->count == capacity) {
+                uint32_t* rows = realloc(out->rows, capacity * 2 * sizeof(uint32_t));
+                if (!rows) {
+                    ok = 0;
+                    break;
+                }
+                out->rows = rows;
+                capacity *= 2;
+            }
+            out->rows[out->count++] = row;
+            flags |= PAINT_STALE;
+        }
+        ok = id_index_put(&paint, row, flags);
+
+        const uint32_t* parents = table_parents(table, row);
+        for (uint32_t i = 0; ok && i < table->parent_counts[row]; i++) {
+            uint32_t parent;
+            if (!id_index_get(&table->id_index, parents[i], &parent)) continue;
+            uint32_t parent_flags = paint_of(&paint, parent);
+            if ((parent_flags & flags) == flags) continue;
+            ok = paint_row(&paint, &heap, &fresh, parent, flags);
+        }
+    }
+
+    free(heap.rows);
+    id_index_free(&paint);
+    if (!ok) {
+        free_traversal(out);
+        return 0;
+    }
+
+    // Drop any candidate that is itself an ancestor of another one.
+    size_t kept = 0;
+    for (size_t i = 0; i < out->count; i++) {
+        uint32_t id = table->ids[out->rows[i]];
+        int redundant = 0;
+        for (size_t j = 0; j < out->count && !redundant; j++) {
+            if (j != i && !precedes(table, id, table->ids[out->rows[j]], &redundant)) {
+                free_traversal(out);
+                return 0;
+            }
+        }
+        if (!redundant) out->rows[kept++] = out->rows[i];
+    }
+    out->count = kept;
+    return 1;
+}
@@ -0,0 +1,310 @@
+#define _POSIX_C_SOURCE 200809L
+#include "import.h"
+#include "db.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char* skip_space(const char* p) {
+    while (*p && isspace((unsigned char)*p)) p++;
+    return (char*)p;
+}
+
+// Reads the four hex digits at `p` into `code`. Returns 0 if there are
+// fewer, without looking past the first non-digit.
+static int parse_hex4(const char* p, unsigned* code) {
+    *code = 0;
+    for (int i = 0; i < 4; i++) {
+        unsigned char c = (unsigned char)p[i];
+        if (!isxdigit(c)) return 0;
+        *code = *code << 4 | (unsigned)(isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+    }
+    return 1;
+}
+
+// Writes `code` to `dest` as UTF-8 and returns the number of bytes.
+static size_t encode_utf8(unsigned code, char* dest) {
+    if (code < 0x80) {
+        dest[0] = (char)code;
+        return 1;
+    } else if (code < 0x800) {
+        dest[0] = (char)(0xC0 | code >> 6);
+        dest[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    } else if (code < 0x10000) {
+        dest[0] = (char)(0xE0 | code >> 12);
+        dest[1] = (char)(0x80 | (code >> 6 & 0x3F));
+        dest[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    dest[0] = (char)(0xF0 | code >> 18);
+    dest[1] = (char)(0x80 | (code >> 12 & 0x3F));
+    dest[2] = (char)(0x80 | (code >> 6 & 0x3F));
+    dest[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+// Copies a JSON string (positioned after the opening quote) into `out`,
+// truncating to at most `out_size - 1` bytes without splitting a
+// character. \u escapes are written as UTF-8, a surrogate pair as one
+// code point and an unpaired surrogate as U+FFFD. Returns the position
+// after the closing quote, or NULL if the string is unterminated or
+// malformed. Unescaping never lengthens the string (6 bytes of escape
+// become at most 3, or 12 at most 4), so `out` may be the string itself.
+static const char* parse_json_string(const char* p, char* out, size_t out_size) {
+    size_t len = 0;
+    while (*p && *p != '"') {
+        char bytes[4];
+        size_t n = 1;
+        bytes[0] = *p++;
+        if (bytes[0] == '\\') {
+            switch (*p++) {
+                case 'n': bytes[0] = '\n'; break;
+                case 't': bytes[0] = '\t'; break;
+                case 'r': bytes[0] = '\r'; break;
+                case 'b': bytes[0] = '\b'; break;
+                case 'f': bytes[0] = '\f'; break;
+                case 'u': {
+                    unsigned code, low;
+                    if (!parse_hex4(p, &code)) return NULL;
+                    p += 4;
+                    if (code >= 0xD800 && code < 0xDC00 && p[0] == '\\' && p[1] == 'u' &&
+                        parse_hex4(p + 2, &low) && low >= 0xDC00 && low < 0xE000) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    } else if (code >= 0xD800 && code < 0xE000) {
+                        code = 0xFFFD;
+                    }
+                    n = encode_utf8(code, bytes);
+                    break;
+                }
+                case '\0': return NULL;
+                default: bytes[0] = p[-1]; break; // \" \\ \/
+            }
+        }
+        if (out && len + n < out_size) {
+            memcpy(out + len, bytes, n);
+            len += n;
+        } else {
+            out_size = 0; // Truncated; later characters are dropped too
+        }
+    }
+    if (*p != '"') return NULL;
+    if (out) out[len] = '\0';
+    return p + 1;
+}
+
+// Unescapes a JSON string value in place and points `out` at it.
+static char* parse_json_data(char* p, Event* out) {
+    char* end = (char*)parse_json_string(p, p, (size_t)-1);
+    if (!end) return NULL;
+    out->data = p;
+    out->data_length = (uint32_t)strlen(p);
+    return end;
+}
+
+// Skips over any JSON value this parser does not care about.
+static const char* skip_json_value(const char* p) {
+    p = skip_space(p);
+    if (*p == '"') return parse_json_string(p + 1, NULL, 0);
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (*p) {
+            if (*p == '"') {
+                p = parse_json_string(p + 1, NULL, 0);
+                if (!p) return NULL;
+                continue;
+            }
+            if (*p == '{' || *p == '[') depth++;
+            if (*p == '}' || *p == ']') {
+                if (--depth == 0) return p + 1;
+            }
+            p++;
+        }
+        return NULL;
+    }
+    while (*p && *p != ',' && *p != '}' && *p != ']') p++;
+    return p;
+}
+
+int parse_event_json(char** json, Event* out, BlobHeap* overflow) {
+    char* p = skip_space(*json);
+    if (*p != '{') return 0;
+    p++;
+
+    out->id = 0;
+    out->parent_count = 0;
+    out->data = "";
+    out->data_length = 0;
+
+    while (1) {
+        p = skip_space(p);
+        if (*p == '}') break;
+        if (*p != '"') return 0;
+
+        char key[32];
+        p = (char*)parse_json_string(p + 1, key, sizeof(key));
+        if (!p) return 0;
+        p = skip_space(p);
+        if (*p != ':') return 0;
+        p = skip_space(p + 1);
+
+        if (strcmp(key, "id") == 0) {
+            char* end;
+            out->id = (uint32_t)strtoul(p, &end, 10);
+            if (end == p) return 0;
+            p = end;
+        } else if (strcmp(key, "data") == 0) {
+            if (*p != '"') return 0;
+            p = parse_json_data(p + 1, out);
+        } else if (strcmp(key, "parents") == 0) {
+            if (*p != '[') return 0;
+            p = parse_parent_list(p + 1, out, overflow);
+            if (!p || *p != ']') return 0;
+            p++;
+        } else {
+            // parent_count is derived from the parents array
+            p = (char*)skip_json_value(p);
+        }
+        if (!p) return 0;
+
+        p = skip_space(p);
+        if (*p == ',') p++;
+    }
+
+    *json = p + 1;
+    return out->id != 0;
+}
+
+int parse_event_csv(char* line, Event* out, BlobHeap* overflow) {
+    char* end;
+    out->id = (uint32_t)strtoul(line, &end, 10);
+    out->parent_count = 0;
+    if (end == line || *end != ',') return 0;
+
+    char* p = end + 1;
+    char* data = p;
+    size_t len = 0;
+    if (*p == '"') {
+        // Unquote in place: "" becomes ", so the field only shrinks.
+        data = ++p;
+        while (*p) {
+            if (*p == '"') {
+                if (p[1] != '"') break;
+                p++;
+            }
+            data[len++] = *p++;
+        }
+        if (*p != '"') return 0;
+        p++;
+    } else {
+        while (*p && *p != ',' && *p != '\n' && *p != '\r') p++;
+        len = (size_t)(p - data);
+    }
+    out->data = data;
+    out->data_length = (uint32_t)len;
+
+    if (*p == ',' && !parse_parent_list(p + 1, out, overflow)) return 0;
+    return out->id != 0;
+}
+
+// Writes a batch, skipping ids that already exist. If the batch repeats
+// an id within itself, falls back to inserting its events one at a time.
+// If writing to disk fails, sets write_failed; the events are in the
+// table by then and count as imported, and the next commit retries.
+static void flush_batch(Event* batch, size_t n, Table* table, ImportStats* stats) {
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (lookup_row(batch[i].id, table, NULL)) {
+            stats->skipped++;
+        } else {
+            batch[kept++] = batch[i];
+        }
+    }
+    if (kept == 0) return;
+
+    InsertResult result = insert_events(batch, kept, table);
+    if (result == INSERT_SUCCESS || result == INSERT_IO_ERROR) {
+        stats->imported += kept;
+        stats->write_failed = result == INSERT_IO_ERROR;
+        return;
+    }
+    for (size_t i = 0; i < kept; i++) {
+        result = insert_event(&batch[i], table);
+        if (result == INSERT_SUCCESS || result == INSERT_IO_ERROR) {
+            stats->imported++;
+            if (result == INSERT_IO_ERROR) {
+                stats->write_failed = 1;
+                return;
+            }
+        } else if (result == INSERT_DUPLICATE_ID) {
+            stats->skipped++;
+        } else {
+            stats->invalid++;
+        }
+    }
+}
+
+int import_file(const char* filename, Table* table, ImportStats* stats) {
+    stats->imported = 0;
+    stats->skipped = 0;
+    stats->invalid = 0;
+    stats->write_failed = 0;
+
+    FILE* file = fopen(filename, "r");
+    if (!file) return 0;
+
+    size_t name_len = strlen(filename);
+    int csv = name_len >= 4 && strcmp(filename + name_len - 4, ".csv") == 0;
+
+    // Parsed events point into their line, so every event in a batch keeps
+    // a line buffer of its own until the batch is flushed. Long parent
+    // lists go to `overflow`, which is emptied with each batch.
+    BlobHeap overflow;
+    blob_heap_init(&overflow);
+    Event* batch = malloc(IMPORT_BATCH_EVENTS * sizeof(Event));
+    char** lines = calloc(IMPORT_BATCH_EVENTS, sizeof(char*));
+    size_t* line_capacity = calloc(IMPORT_BATCH_EVENTS, sizeof(size_t));
+    if (!batch || !lines || !line_capacity) {
+        free(batch);
+        free(lines);
+        free(line_capacity);
+        fclose(file);
+        return 0;
+    }
+
+    size_t count = 0;
+    size_t line_number = 0;
+    while (getline(&lines[count], &line_capacity[count], file) > 0) {
+        line_number++;
+        char* p = skip_space(lines[count]);
+        if (*p == '\0') continue;
+        if (csv && line_number == 1 && !isdigit((unsigned char)*p)) continue; // Header row
+
+        int parsed = csv ? parse_event_csv(p, &batch[count], &overflow)
+                         : parse_event_json(&p, &batch[count], &overflow);
+        if (!parsed) {
+            stats->invalid++;
+            continue;
+        }
+        if (++count == IMPORT_BATCH_EVENTS) {
+            flush_batch(batch, count, table, stats);
+            blob_heap_free(&overflow);
+            count = 0;
+            if (stats->write_failed) break;
+        }
+    }
+    if (count > 0 && !stats->write_failed) flush_batch(batch, count, table, stats);
+    if (!stats->write_failed && !commit_log()) stats->write_failed = 1;
+    blob_heap_free(&overflow);
+
+    for (size_t i = 0; i < IMPORT_BATCH_EVENTS; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+    free(line_capacity);
+    free(batch);
+    fclose(file);
+    return 1;
+}
@@ -0,0 +1,214 @@
+#include "index.h"
+#include <stdlib.h>
+
+static inline size_t hash_id(uint32_t key) {
+    // Fibonacci hashing spreads sequential ids across the table.
+    return (size_t)((key * 2654435769u) ^ (key >> 16));
+}
+
+void id_index_init(IdIndex* index) {
+    index->keys = NULL;
+    index->values = NULL;
+    index->capacity = 0;
+    index->count = 0;
+}
+
+void id_index_free(IdIndex* index) {
+    free(index->keys);
+    free(index->values);
+    id_index_init(index);
+}
+
+static void insert_slot(uint32_t* keys, uint32_t* values, size_t capacity,
+                        uint32_t key, uint32_t stored) {
+    size_t mask = capacity - 1;
+    size_t i = hash_id(key) & mask;
+    while (values[i] && keys[i] != key) {
+        i = (i + 1) & mask;
+    }
+    keys[i] = key;
+    values[i] = stored;
+}
+
+int id_index_reserve(IdIndex* index, size_t count) {
+    // Keep the load factor at or below 1/2 so probe sequences stay short.
+    size_t capacity = index->capacity ? index->capacity : ID_INDEX_MIN_CAPACITY;
+    while (capacity < count * 2) capacity *= 2;
+    if (capacity == index->capacity) return 1;
+
+    uint32_t* keys = malloc(capacity * sizeof(uint32_t));
+    uint32_t* values = calloc(capacity, sizeof(uint32_t));
+    if (!keys || !values) {
+        free(keys);
+        free(values);
+        return 0;
+    }
+
+    for (size_t i = 0; i < index->capacity; i++) {
+        if (index->values[i]) {
+            insert_slot(keys, values, capacity, index->keys[i], index->values[i]);
+        }
+    }
+
+    free(index->keys);
+    free(index->values);
+    index->keys = keys;
+    index->values = values;
+    index->capacity = capacity;
+    return 1;
+}
+
+int id_index_get(const IdIndex* index, uint32_t key, uint32_t* value) {
+    if (index->capacity == 0) return 0;
+
+    size_t mask = index->capacity - 1;
+    size_t i = hash_id(key) & mask;
+    while (index->values[i]) {
+        if (index->keys[i] == key) {
+            if (value) *value = index->values[i] - 1;
+            return 1;
+        }
+        i = (i + 1) & mask;
+    }
+    return 0;
+}
+
+int id_index_put(IdIndex* index, uint32_t key, uint32_t value) {
+    if (!id_index_reserve(index, index->count + 1)) return 0;
+
+    size_t mask = index->capacity - 1;
+    size_t i = hash_id(key) & mask;
+    while (index->values[i]) {
+        if (index->keys[i] == key) {
+            index->values[i] = value + 1;
+            return 1;
+        }
+        i = (i + 1) & mask;
+    }
+    index->keys[i] = key;
+    index->values[i] = value + 1;
+    index->count++;
+    return 1;
+}
+
+void child_index_init(ChildIndex* index) {
+    id_index_init(&index->lists);
+    index->list_slots = NULL;
+    index->num_lists = 0;
+    index->max_lists = 0;
+    index->edges = NULL;
+    index->num_edges = 0;
+    index->max_edges = 0;
+}
+
+void child_index_free(ChildIndex* index) {
+    id_index_free(&index->lists);
+    free(index->list_slots);
+    free(index->edges);
+    child_index_init(index);
+}
+
+static int grow_array(void** array, size_t* max, size_t needed, size_t elem_size) {
+    if (needed <= *max) return 1;
+    size_t capacity = *max ? *max : ID_INDEX_MIN_CAPACITY;
+    while (capacity < needed) capacity *= 2;
+    void* grown = realloc(*array, capacity * elem_size);
+    if (!grown) return 0;
+    *array = grown;
+    *max = capacity;
+    return 1;
+}
+
+// Reserves room for `parents` new parent lists and `edges` new edges, so
+// that the following child_index_add() calls cannot fail.
+int child_index_reserve(ChildIndex* index, size_t parents, size_t edges) {
+    return id_index_reserve(&index->lists, index->lists.count + parents) &&
+           grow_array((void**)&index->list_slots, &index->max_lists,
+                      index->num_lists + parents, sizeof(ChildList)) &&
+           grow_array((void**)&index->edges, &index->max_edges,
+                      index->num_edges + edges, sizeof(ChildEdge));
+}
+
+int child_index_add(ChildIndex* index, uint32_t parent_id, uint32_t child_row) {
+    if (!child_index_reserve(index, 1, 1)) return 0;
+
+    uint32_t edge = (uint32_t)index->num_edges++;
+    index->edges[edge].child_row = child_row;
+    index->edges[edge].next = EDGE_NONE;
+
+    uint32_t slot;
+    if (id_index_get(&index->lists, parent_id, &slot)) {
+        ChildList* list = &index->list_slots[slot];
+        index->edges[list->tail].next = edge;
+        list->tail = edge;
+        list->count++;
+    } else {
+        slot = (uint32_t)index->num_lists++;
+        ChildList* list = &index->list_slots[slot];
+        list->head = edge;
+        list->tail = edge;
+        list->count = 1;
+        id_index_put(&index->lists, parent_id, slot);
+    }
+    return 1;
+}
+
+const ChildList* child_index_list(const ChildIndex* index, uint32_t parent_id) {
+    uint32_t slot;
+    if (!id_index_get(&index->lists, parent_id, &slot)) return NULL;
+    return &index->list_slots[slot];
+}
+
+void reach_index_init(ReachIndex* index) {
+    index->generation = NULL;
+    index->chain = NULL;
+    index->position = NULL;
+    index->label_start = NULL;
+    index->label_count = NULL;
+    index->chain_lengths = NULL;
+    index->capacity = 0;
+    index->num_chains = 0;
+    index->entries = NULL;
+    index->num_entries = 0;
+    index->entry_capacity = 0;
+    index->stale = 0;
+}
+
+void reach_index_free(ReachIndex* index) {
+    free(index->generation);
+    free(index->chain);
+    free(index->position);
+    free(index->label_start);
+    free(index->label_count);
+    free(index->chain_lengths);
+    free(index->entries);
+    reach_index_init(index);
+}
+
+static int resize_array(void** array, size_t capacity, size_t size) {
+    void* grown = realloc(*array, capacity * size);
+    if (!grown) return 0;
+    *array = grown;
+    return 1;
+}
+
+int reach_index_reserve(ReachIndex* index, size_t rows) {
+    if (rows <= index->capacity) return 1;
+    size_t capacity = index->capacity ? index->capacity : ID_INDEX_MIN_CAPACITY;
+    while (capacity < rows) capacity *= 2;
+
+    if (!resize_array((void**)&index->generation, capacity, sizeof(uint32_t)) ||
+        !resize_array((void**)&index->chain, capacity, sizeof(uint32_t)) ||
+        !resize_array((void**)&index->position, capacity, sizeof(uint32_t)) ||
+        !resize_array((void**)&index->label_start, capacity, sizeof(size_t)) ||
+        !resize_array((void**)&index->label_count, capacity, sizeof(uint32_t)) ||
+        !resize_array((void**)&index->chain_lengths, capacity, sizeof(uint32_t))) {
+        return 0;
+    }
+    index->capacity = capacity;
+    return 1;
+}
+
+int reach_index_reserve_entries(ReachIndex* index, size_t entries) {
+    return grow_array((void**)&index->entries, &index->entry_capacity, entries, sizeof(ReachEntry));
+}
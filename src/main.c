@@ -5,20 +5,19 @@
 #include "db.h"
 #include "statement.h"
 #include "repl.h"
-
-void print_event(Event* e) {
-    printf("%u: %s\n", e->id, e->data);
-    printf(" ⬑ Parents:");
-    for (int i = 0; i < e->parent_count; i++) {
-        printf(" %u", e->parents[i]);
-    }
-    printf("\n");
-}
+#include "import.h"
+#include "export.h"
 
 int main() {
-    open_db("causal.cdb");
-
-    Table* table = load_table("causal.cdb");
+    LoadStats stats;
+    Table* table = load_table_with_stats("causal.cdb", &stats);
+    printf("Loaded %zu events (%zu bytes) from causal.cdb\n", stats.rows_read, stats.bytes_read);
+    if (stats.torn_bytes > 0) {
+        printf("Recovered from an interrupted write (%zu bytes discarded).\n", stats.torn_bytes);
+    }
+    if (stats.corrupt_rows > 0) {
+        printf("Warning: skipped %zu corrupt events (checksum mismatch).\n", stats.corrupt_rows);
+    }
 
     InputBuffer* input_buffer = new_input_buffer();
 
@@ -28,9 +27,47 @@ int main() {
 
         if (strncmp(input_buffer->buffer, ".exit", 5) == 0) {
             break;
+        } else if (strncmp(input_buffer->buffer, ".durability ", 12) == 0) {
+            Durability mode;
+            if (parse_durability(input_buffer->buffer + 12, &mode)) {
+                set_durability(mode);
+            } else {
+                printf("Unknown durability mode. Use none, group or full.\n");
+            }
+            continue;
+        } else if (strncmp(input_buffer->buffer, ".import ", 8) == 0) {
+            ImportStats import_stats;
+            if (import_file(input_buffer->buffer + 8, table, &import_stats)) {
+                printf("Imported %zu events (%zu already existed, %zu invalid).\n",
+                       import_stats.imported, import_stats.skipped, import_stats.invalid);
+                if (import_stats.write_failed) {
+                    printf("Error: failed to write to disk; the import stopped early.\n");
+                }
+            } else {
+                printf("Could not read %s\n", input_buffer->buffer + 8);
+            }
+            continue;
+        } else if (strncmp(input_buffer->buffer, ".export ", 8) == 0) {
+            char* format = input_buffer->buffer + 8;
+            char* filename = strchr(format, ' ');
+            if (filename) *filename++ = '\0';
+            int columnar = strcmp(format, "columnar") == 0;
+            if (!filename || (!columnar && strcmp(format, "binary") != 0)) {
+                printf("Usage: .export binary|columnar <file>\n");
+                continue;
+            }
+            FILE* out = fopen(filename, "wb");
+            int written = out && (columnar ? export_columnar(table, out) : export_binary(table, out));
+            if (out && fclose(out) != 0) written = 0;
+            if (written) {
+                printf("Exported the database to %s\n", filename);
+            } else {
+                printf("Could not write %s\n", filename);
+            }
+            continue;
         } else if (strncmp(input_buffer->buffer, ".list", 5) == 0) {
             for (size_t i = 0; i < table->num_events; i++) {
-                print_event(&table->events[i]);
+                if (is_served_row(table, (uint32_t)i)) print_row(table, i);
             }
             continue;
         }
@@ -40,15 +77,20 @@ int main() {
 
         if (type == STATEMENT_UNKNOWN) {
             printf("Unrecognized command: %s\n", input_buffer->buffer);
+            free_statement(&stmt);
             continue;
         }
 
         stmt.type = type;
         execute_statement(&stmt, table);
+        free_statement(&stmt);
     }
 
+    if (!save_text_index(table)) {
+        printf("Warning: could not save the text index.\n");
+    }
     close_db();
-    free(table);
+    free_table(table);
     close_input_buffer(input_buffer);
     return 0;
 }
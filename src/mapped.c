@@ -0,0 +1,54 @@
+#define _POSIX_C_SOURCE 200809L
+#include "mapped.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static MappedFile* mappings; // Every mapping still in use
+
+MappedFile* mapped_open(int fd, size_t size) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("fstat");
+        return NULL;
+    }
+    for (MappedFile* file = mappings; file; file = file->next) {
+        if (file->device == (uint64_t)st.st_dev && file->inode == (uint64_t)st.st_ino && file->size >= size) {
+            file->refs++;
+            return file;
+        }
+    }
+
+    MappedFile* file = malloc(sizeof(MappedFile));
+    if (!file) return NULL;
+    file->base = NULL;
+    file->size = size;
+    file->device = (uint64_t)st.st_dev;
+    file->inode = (uint64_t)st.st_ino;
+    file->refs = 1;
+    if (size > 0) {
+        void* base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            perror("mmap");
+            free(file);
+            return NULL;
+        }
+        file->base = base;
+    }
+    file->next = mappings;
+    mappings = file;
+    return file;
+}
+
+void mapped_release(MappedFile* file) {
+    if (!file || --file->refs > 0) return;
+    for (MappedFile** link = &mappings; *link; link = &(*link)->next) {
+        if (*link == file) {
+            *link = file->next;
+            break;
+        }
+    }
+    if (file->base) munmap((void*)file->base, file->size);
+    free(file);
+}
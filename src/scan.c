@@ -0,0 +1,145 @@
+#include "scan.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_HAVE_X86 1
+#endif
+
+typedef enum {
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2
+} ScanLevel;
+
+static size_t scan_u32_scalar(const uint32_t* values, size_t count, uint32_t key) {
+    for (size_t i = 0; i < count; i++) {
+        if (values[i] == key) return i;
+    }
+    return count;
+}
+
+static const char* scan_substring_scalar(const char* haystack, size_t length,
+                                         const char* needle, size_t needle_length) {
+    if (needle_length > length) return NULL;
+    const char* end = haystack + length - needle_length + 1;
+    for (const char* p = haystack; p < end; p++) {
+        p = memchr(p, needle[0], (size_t)(end - p));
+        if (!p) return NULL;
+        if (memcmp(p, needle, needle_length) == 0) return p;
+    }
+    return NULL;
+}
+
+#ifdef SCAN_HAVE_X86
+// The substring kernels compare a block of candidate start positions
+// against the needle's first and last bytes at once, and only confirm the
+// positions where both match. They stop where a block could read past the
+// haystack and leave the rest to the scalar loop.
+
+__attribute__((target("sse2")))
+static size_t scan_u32_sse2(const uint32_t* values, size_t count, uint32_t key) {
+    __m128i k = _mm_set1_epi32((int)key);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(values + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(block, k)));
+        if (mask) return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+    return i + scan_u32_scalar(values + i, count - i, key);
+}
+
+__attribute__((target("sse2")))
+static const char* scan_substring_sse2(const char* haystack, size_t length,
+                                       const char* needle, size_t needle_length) {
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+    size_t i = 0;
+    for (; i + needle_length - 1 + 16 <= length; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i*)(haystack + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i*)(haystack + i + needle_length - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+        while (mask) {
+            size_t candidate = i + (size_t)__builtin_ctz(mask);
+            if (memcmp(haystack + candidate, needle, needle_length) == 0) return haystack + candidate;
+            mask &= mask - 1;
+        }
+    }
+    return scan_substring_scalar(haystack + i, length - i, needle, needle_length);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_u32_avx2(const uint32_t* values, size_t count, uint32_t key) {
+    __m256i k = _mm256_set1_epi32((int)key);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(values + i));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(block, k)));
+        if (mask) return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+    return i + scan_u32_scalar(values + i, count - i, key);
+}
+
+__attribute__((target("avx2")))
+static const char* scan_substring_avx2(const char* haystack, size_t length,
+                                       const char* needle, size_t needle_length) {
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[needle_length - 1]);
+    size_t i = 0;
+    for (; i + needle_length - 1 + 32 <= length; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i*)(haystack + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i*)(haystack + i + needle_length - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+        while (mask) {
+            size_t candidate = i + (size_t)__builtin_ctz(mask);
+            if (memcmp(haystack + candidate, needle, needle_length) == 0) return haystack + candidate;
+            mask &= mask - 1;
+        }
+    }
+    return scan_substring_scalar(haystack + i, length - i, needle, needle_length);
+}
+#endif
+
+static ScanLevel scan_level() {
+#ifdef SCAN_HAVE_X86
+    static int level = -1;
+    if (level < 0) {
+        level = __builtin_cpu_supports("avx2") ? SCAN_AVX2
+              : __builtin_cpu_supports("sse2") ? SCAN_SSE2
+              : SCAN_SCALAR;
+    }
+    return (ScanLevel)level;
+#else
+    return SCAN_SCALAR;
+#endif
+}
+
+size_t scan_u32(const uint32_t* values, size_t count, uint32_t key) {
+    switch (scan_level()) {
+#ifdef SCAN_HAVE_X86
+        case SCAN_AVX2:
+            return scan_u32_avx2(values, count, key);
+        case SCAN_SSE2:
+            return scan_u32_sse2(values, count, key);
+#endif
+        default:
+            return scan_u32_scalar(values, count, key);
+    }
+}
+
+const char* scan_substring(const char* haystack, size_t length, const char* needle, size_t needle_length) {
+    if (needle_length == 0) return haystack;
+    if (needle_length > length) return NULL;
+    switch (scan_level()) {
+#ifdef SCAN_HAVE_X86
+        case SCAN_AVX2:
+            return scan_substring_avx2(haystack, length, needle, needle_length);
+        case SCAN_SSE2:
+            return scan_substring_sse2(haystack, length, needle, needle_length);
+#endif
+        default:
+            return scan_substring_scalar(haystack, length, needle, needle_length);
+    }
+}
@@ -0,0 +1,94 @@
+#define _POSIX_C_SOURCE 200809L
+#include "snapshot.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void snapshot_store_open(SnapshotStore* store, const char* filename, LoadStats* stats) {
+    store->tables[0] = load_table_with_stats(filename, stats);
+    // The second load finds the files already recovered and the text
+    // index saved, and leaves the database open for appending.
+    store->tables[1] = load_table(filename);
+    for (int side = 0; side < 2; side++) {
+        for (int slot = 0; slot < SNAPSHOT_READER_SLOTS; slot++) {
+            store->readers[side][slot].count = 0;
+        }
+    }
+    store->published = 0;
+    pthread_mutex_init(&store->writer, NULL);
+}
+
+void snapshot_store_close(SnapshotStore* store) {
+    free_table(store->tables[0]);
+    free_table(store->tables[1]);
+    store->tables[0] = store->tables[1] = NULL;
+    pthread_mutex_destroy(&store->writer);
+}
+
+Table* snapshot_acquire(SnapshotStore* store, unsigned slot, int* side) {
+    long* count;
+    while (1) {
+        int published = __atomic_load_n(&store->published, __ATOMIC_SEQ_CST);
+        count = &store->readers[published][slot % SNAPSHOT_READER_SLOTS].count;
+        __atomic_fetch_add(count, 1, __ATOMIC_SEQ_CST);
+        // If the writer switched copies in between, it may already have
+        // checked this counter; announce ourselves on the new copy instead.
+        if (__atomic_load_n(&store->published, __ATOMIC_SEQ_CST) == published) {
+            *side = published;
+            return store->tables[published];
+        }
+        __atomic_fetch_sub(count, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+void snapshot_release(SnapshotStore* store, unsigned slot, int side) {
+    __atomic_fetch_sub(&store->readers[side][slot % SNAPSHOT_READER_SLOTS].count, 1, __ATOMIC_RELEASE);
+}
+
+// Waits until no reader is left on copy `side`.
+static void drain_readers(SnapshotStore* store, int side) {
+    for (int slot = 0; slot < SNAPSHOT_READER_SLOTS; slot++) {
+        while (__atomic_load_n(&store->readers[side][slot].count, __ATOMIC_SEQ_CST) != 0) {
+            sched_yield();
+        }
+    }
+}
+
+void snapshot_insert(SnapshotStore* store, SnapshotWrite* writes) {
+    pthread_mutex_lock(&store->writer);
+    int old = store->published;
+    int next = 1 - old;
+
+    int inserted = 0;
+    for (SnapshotWrite* write = writes; write; write = write->next) {
+        write->result = stage_events(write->events, write->count, store->tables[next]);
+        if (write->result == INSERT_SUCCESS) inserted = 1;
+    }
+    if (inserted) {
+        // Readers must never have to rebuild an index, so do it before
+        // they can see the copy.
+        refresh_indexes(store->tables[next]);
+        __atomic_store_n(&store->published, next, __ATOMIC_SEQ_CST);
+        drain_readers(store, old);
+
+        // Both copies hold the same events, so the replay passes the same
+        // checks; only running out of memory can make it fail.
+        for (SnapshotWrite* write = writes; write; write = write->next) {
+            if (write->result != INSERT_SUCCESS) continue;
+            if (replay_events(write->events, write->count, store->tables[old]) != INSERT_SUCCESS) {
+                fprintf(stderr, "Error: could not update the second copy of the table\n");
+                exit(1);
+            }
+        }
+        refresh_indexes(store->tables[old]);
+    }
+    pthread_mutex_unlock(&store->writer);
+
+    // Writers that staged while another one was syncing share the next
+    // group, so the commit happens outside the writer lock.
+    if (inserted && !commit_log()) {
+        for (SnapshotWrite* write = writes; write; write = write->next) {
+            if (write->result == INSERT_SUCCESS) write->result = INSERT_IO_ERROR;
+        }
+    }
+}
@@ -3,33 +3,114 @@
 #include <stdio.h>
 #include "db.h"
 #include "statement.h"
+#include "graph.h"
+#include "scan.h"
 
-StatementType parse_statement(const char* input, Statement* statement) {
-    if (strncmp(input, "insert", 6) == 0) {
-        statement->type = STATEMENT_INSERT;
+void print_row(Table* table, size_t row) {
+    printf("%u: %.*s\n", table->ids[row], (int)table->data_lengths[row], table->data[row]);
+    printf(" ⬑ Parents:");
+    const uint32_t* parents = table_parents(table, row);
+    for (uint32_t i = 0; i < table->parent_counts[row]; i++) {
+        printf(" %u", parents[i]);
+    }
+    printf("\n");
+}
 
-        Event* e = &statement->event;
-        e->parent_count = 0;
+// Parses one `<id> "<data>" [parent ...]` row of an insert, stopping at
+// the next ';' or the end of input. The event's data points into `p`.
+// Returns NULL if the row is malformed.
+static const char* parse_insert_row(const char* p, Event* e, BlobHeap* overflow) {
+    char* end;
+    e->id = (uint32_t)strtoul(p, &end, 10);
+    if (end == p) return NULL;
 
-        char buffer[256];
-        strncpy(buffer, input + 7, sizeof(buffer));
-        buffer[sizeof(buffer) - 1] = '\0';
+    p = strchr(end, '"');
+    if (!p) return NULL;
+    const char* data_end = strchr(++p, '"');
+    if (!data_end) return NULL;
+    e->data = p;
+    e->data_length = (uint32_t)(data_end - p);
 
-        char* token = strtok(buffer, " ");
-        if (!token) return STATEMENT_UNKNOWN;
-        e->id = atoi(token);
+    p = parse_parent_list(data_end + 1, e, overflow);
+    if (!p || (*p != '\0' && *p != ';')) return NULL;
+    return p;
+}
 
-        token = strtok(NULL, "\"");
-        if (!token) return STATEMENT_UNKNOWN;
-        strncpy(e->data, token, MAX_DATA_LENGTH);
+StatementType parse_statement(const char* input, Statement* statement) {
+    blob_heap_init(&statement->overflow);
+    if (strncmp(input, "insert", 6) == 0) {
+        // insert <id> "<data>" [parents...] [; <id> "<data>" [parents...] ...]
+        statement->type = STATEMENT_INSERT;
+        statement->event_count = 0;
 
-        token = strtok(NULL, " ");
-        while (token && e->parent_count < MAX_PARENTS) {
-            e->parents[e->parent_count++] = atoi(token);
-            token = strtok(NULL, " ");
+        const char* p = input + 6;
+        while (*p) {
+            if (statement->event_count == STATEMENT_MAX_EVENTS) return STATEMENT_UNKNOWN;
+            p = parse_insert_row(p, &statement->events[statement->event_count++], &statement->overflow);
+            if (!p) return STATEMENT_UNKNOWN;
+            if (*p == ';') p++;
         }
+        if (statement->event_count == 0) return STATEMENT_UNKNOWN;
 
         return STATEMENT_INSERT;
+    } else if (strncmp(input, "children", 8) == 0) {
+        statement->type = STATEMENT_CHILDREN;
+        statement->query_id = atoi(input + 9);
+        return STATEMENT_CHILDREN;
+    } else if (strncmp(input, "ancestors", 9) == 0 || strncmp(input, "descendants", 11) == 0) {
+        int ancestors = input[0] == 'a';
+        statement->type = ancestors ? STATEMENT_ANCESTORS : STATEMENT_DESCENDANTS;
+        statement->query_id = 0;
+        statement->depth = 0;
+        statement->limit = 0;
+        if (sscanf(input + (ancestors ? 9 : 11), "%u %u %u",
+                   &statement->query_id, &statement->depth, &statement->limit) < 1) {
+            return STATEMENT_UNKNOWN;
+        }
+        return statement->type;
+    } else if (strncmp(input, "common_ancestors", 16) == 0) {
+        statement->type = STATEMENT_COMMON_ANCESTORS;
+        if (sscanf(input + 16, "%u %u", &statement->query_id, &statement->other_id) != 2) {
+            return STATEMENT_UNKNOWN;
+        }
+        return STATEMENT_COMMON_ANCESTORS;
+    } else if (strncmp(input, "precedes", 8) == 0) {
+        statement->type = STATEMENT_PRECEDES;
+        if (sscanf(input + 8, "%u %u", &statement->query_id, &statement->other_id) != 2) {
+            return STATEMENT_UNKNOWN;
+        }
+        return STATEMENT_PRECEDES;
+    } else if (strncmp(input, "find where data contains", 24) == 0) {
+        // find where data contains "<text>"
+        statement->type = STATEMENT_FIND;
+        const char* p = strchr(input + 24, '"');
+        if (!p) return STATEMENT_UNKNOWN;
+        const char* end = strchr(++p, '"');
+        if (!end) return STATEMENT_UNKNOWN;
+        statement->pattern = p;
+        statement->pattern_length = (uint32_t)(end - p);
+        return STATEMENT_FIND;
+    } else if (strncmp(input, "search", 6) == 0) {
+        // search "<words>" [ancestors <id> | descendants <id>]
+        statement->type = STATEMENT_SEARCH;
+        const char* p = strchr(input + 6, '"');
+        if (!p) return STATEMENT_UNKNOWN;
+        const char* end = strchr(++p, '"');
+        if (!end) return STATEMENT_UNKNOWN;
+        statement->pattern = p;
+        statement->pattern_length = (uint32_t)(end - p);
+        statement->scope = SEARCH_ALL;
+
+        char scope[16];
+        int n = sscanf(end + 1, "%15s %u", scope, &statement->query_id);
+        if (n == 2 && strcmp(scope, "ancestors") == 0) {
+            statement->scope = SEARCH_ANCESTORS;
+        } else if (n == 2 && strcmp(scope, "descendants") == 0) {
+            statement->scope = SEARCH_DESCENDANTS;
+        } else if (n != EOF) {
+            return STATEMENT_UNKNOWN;
+        }
+        return STATEMENT_SEARCH;
     } else if (strncmp(input, "get", 3) == 0) {
         statement->type = STATEMENT_GET;
         statement->query_id = atoi(input + 4);
@@ -39,25 +120,162 @@ StatementType parse_statement(const char* input, Statement* statement) {
     return STATEMENT_UNKNOWN;
 }
 
+void free_statement(Statement* statement) {
+    blob_heap_free(&statement->overflow);
+}
 
 int execute_statement(Statement* stmt, Table* table) {
     switch (stmt->type) {
-        case STATEMENT_INSERT:
-            insert_event(&stmt->event, table);
-            return 0;
+        case STATEMENT_INSERT: {
+            InsertResult result = stmt->event_count == 1
+                ? insert_event(&stmt->events[0], table)
+                : insert_events(stmt->events, stmt->event_count, table);
+            switch (result) {
+                case INSERT_SUCCESS:
+                    return 0;
+                case INSERT_DUPLICATE_ID:
+                    if (stmt->event_count == 1) {
+                        printf("Error: event %u already exists.\n", stmt->events[0].id);
+                    } else {
+                        printf("Error: duplicate event id in batch; nothing inserted.\n");
+                    }
+                    return 1;
+                case INSERT_DATA_TOO_LONG:
+                    printf("Error: event data is longer than %d bytes.\n", MAX_DATA_LENGTH);
+                    return 1;
+                case INSERT_TOO_MANY_PARENTS:
+                    printf("Error: an event can have at most %d parents.\n", MAX_PARENTS);
+                    return 1;
+                case INSERT_OUT_OF_MEMORY:
+                    printf("Error: out of memory.\n");
+                    return 1;
+                case INSERT_IO_ERROR:
+                    printf("Error: failed to write to disk.\n");
+                    return 1;
+            }
+            return 1;
+        }
         case STATEMENT_GET: {
-            Event e;
-            if (find_event_in_memory(stmt->query_id, table, &e) || read_event_by_id(stmt->query_id, &e)) {
-                printf("%u: %s\n ⬑ Parents:", e.id, e.data);
-                for (int i = 0; i < e.parent_count; i++) {
-                    printf(" %u", e.parents[i]);
+            uint32_t row;
+            if (lookup_row(stmt->query_id, table, &row)) {
+                print_row(table, row);
+            } else {
+                printf("Event not found.\n");
+            }
+            return 0;
+        }
+        case STATEMENT_CHILDREN: {
+            const ChildList* list = child_index_list(&table->children, stmt->query_id);
+            if (list) {
+                for (uint32_t edge = list->head; edge != EDGE_NONE; edge = table->children.edges[edge].next) {
+                    print_row(table, table->children.edges[edge].child_row);
                 }
-                printf("\n");
+            } else if (lookup_row(stmt->query_id, table, NULL)) {
+                printf("No children.\n");
             } else {
                 printf("Event not found.\n");
             }
             return 0;
         }
+        case STATEMENT_ANCESTORS:
+        case STATEMENT_DESCENDANTS: {
+            int ancestors = stmt->type == STATEMENT_ANCESTORS;
+            Traversal result;
+            if (!traverse(table, stmt->query_id, ancestors ? TRAVERSE_ANCESTORS : TRAVERSE_DESCENDANTS,
+                          stmt->depth, stmt->limit, &result)) {
+                printf("Event not found.\n");
+                return 0;
+            }
+            for (size_t i = 0; i < result.count; i++) {
+                print_row(table, result.rows[i]);
+            }
+            if (result.count == 0) {
+                printf(ancestors ? "No ancestors.\n" : "No descendants.\n");
+            } else if (result.truncated) {
+                printf("(stopped after %zu events)\n", result.count);
+            }
+            free_traversal(&result);
+            return 0;
+        }
+        case STATEMENT_PRECEDES: {
+            int result;
+            if (!lookup_row(stmt->query_id, table, NULL) || !lookup_row(stmt->other_id, table, NULL)) {
+                printf("Event not found.\n");
+            } else if (!precedes(table, stmt->query_id, stmt->other_id, &result)) {
+                printf("Error: out of memory.\n");
+            } else if (result) {
+                printf("%u causally precedes %u.\n", stmt->query_id, stmt->other_id);
+            } else {
+                printf("%u does not causally precede %u.\n", stmt->query_id, stmt->other_id);
+            }
+            return 0;
+        }
+        case STATEMENT_COMMON_ANCESTORS: {
+            Traversal result;
+            if (!lookup_row(stmt->query_id, table, NULL) || !lookup_row(stmt->other_id, table, NULL)) {
+                printf("Event not found.\n");
+                return 0;
+            }
+            if (!common_ancestors(table, stmt->query_id, stmt->other_id, &result)) {
+                printf("Error: out of memory.\n");
+                return 0;
+            }
+            for (size_t i = 0; i < result.count; i++) {
+                print_row(table, result.rows[i]);
+            }
+            if (result.count == 0) {
+                printf("No common ancestors.\n");
+            }
+            free_traversal(&result);
+            return 0;
+        }
+        case STATEMENT_FIND: {
+            size_t matches = 0;
+            for (size_t row = 0; row < table->num_events; row++) {
+                if (is_served_row(table, (uint32_t)row) &&
+                    scan_substring(table->data[row], table->data_lengths[row],
+                                   stmt->pattern, stmt->pattern_length)) {
+                    print_row(table, row);
+                    matches++;
+                }
+            }
+            if (matches == 0) {
+                printf("No matching events.\n");
+            }
+            return 0;
+        }
+        case STATEMENT_SEARCH: {
+            Traversal matches;
+            if (!search_events(table, stmt->pattern, stmt->pattern_length, &matches)) {
+                printf("Error: out of memory.\n");
+                return 1;
+            }
+            if (stmt->scope != SEARCH_ALL) {
+                Traversal scope;
+                TraversalDirection direction = stmt->scope == SEARCH_ANCESTORS ? TRAVERSE_ANCESTORS
+                                                                                : TRAVERSE_DESCENDANTS;
+                if (!traverse(table, stmt->query_id, direction, 0, 0, &scope)) {
+                    printf("Event not found.\n");
+                    free_traversal(&matches);
+                    return 0;
+                }
+                int ok = intersect_traversal(table, &matches, &scope);
+                free_traversal(&scope);
+                if (!ok) {
+                    printf("Error: out of memory.\n");
+                    free_traversal(&matches);
+                    return 1;
+                }
+            }
+            for (size_t i = 0; i < matches.count; i++) {
+                print_row(table, matches.rows[i]);
+            }
+            if (matches.count == 0) {
+                printf("No matching events.\n");
+            }
+            free_traversal(&matches);
+            return 0;
+        }
         default:
             printf("Unrecognized statement type.\n");
             return 1;
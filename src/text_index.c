@@ -0,0 +1,297 @@
+#define _POSIX_C_SOURCE 200809L
+#include "text_index.h"
+#include "crc32c.h"
+#include "event.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEXT_INDEX_MIN_BUCKETS 256
+
+void text_index_init(TextIndex* index) {
+    memset(index, 0, sizeof(*index));
+}
+
+void text_index_free(TextIndex* index) {
+    for (size_t i = 0; i < index->num_terms; i++) {
+        free(index->terms[i].postings);
+    }
+    free(index->terms);
+    free(index->buckets);
+    free(index->tokens);
+    text_index_init(index);
+}
+
+static inline int is_word_byte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+}
+
+// Copies the next word at or after `*p` into `token`, lowercased, and
+// advances `*p` past it. Returns the word's length, or 0 at the end.
+static size_t next_token(const char** p, const char* end, char* token) {
+    const char* s = *p;
+    while (s < end && !is_word_byte((unsigned char)*s)) s++;
+    size_t length = 0;
+    while (s < end && is_word_byte((unsigned char)*s)) {
+        char c = *s++;
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        if (length < TEXT_TOKEN_MAX) token[length++] = c;
+    }
+    *p = s;
+    return length;
+}
+
+static uint32_t hash_token(const char* token, size_t length) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)token[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Returns the bucket holding `token`, or the empty bucket where it would go.
+static size_t find_bucket(const TextIndex* index, const char* token, size_t length) {
+    size_t mask = index->bucket_capacity - 1;
+    size_t i = hash_token(token, length) & mask;
+    while (index->buckets[i]) {
+        const TextTerm* term = &index->terms[index->buckets[i] - 1];
+        if (term->token_length == length && memcmp(index->tokens + term->token_offset, token, length) == 0) break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static const TextTerm* find_term(const TextIndex* index, const char* token, size_t length) {
+    if (index->bucket_capacity == 0) return NULL;
+    uint32_t slot = index->buckets[find_bucket(index, token, length)];
+    return slot ? &index->terms[slot - 1] : NULL;
+}
+
+static int grow_buckets(TextIndex* index) {
+    size_t capacity = index->bucket_capacity ? index->bucket_capacity * 2 : TEXT_INDEX_MIN_BUCKETS;
+    uint32_t* buckets = calloc(capacity, sizeof(uint32_t));
+    if (!buckets) return 0;
+    free(index->buckets);
+    index->buckets = buckets;
+    index->bucket_capacity = capacity;
+    for (size_t t = 0; t < index->num_terms; t++) {
+        const TextTerm* term = &index->terms[t];
+        index->buckets[find_bucket(index, index->tokens + term->token_offset, term->token_length)] = (uint32_t)t + 1;
+    }
+    return 1;
+}
+
+static int grow_buffer(void** buffer, size_t* capacity, size_t needed, size_t elem_size, size_t minimum) {
+    if (needed <= *capacity) return 1;
+    size_t grown_capacity = *capacity ? *capacity : minimum;
+    while (grown_capacity < needed) grown_capacity *= 2;
+    void* grown = realloc(*buffer, grown_capacity * elem_size);
+    if (!grown) return 0;
+    *buffer = grown;
+    *capacity = grown_capacity;
+    return 1;
+}
+
+// Returns the term for `token`, adding an empty one if it is new.
+static TextTerm* intern_term(TextIndex* index, const char* token, size_t length) {
+    // Keep the table at most half full.
+    if ((index->num_terms + 1) * 2 > index->bucket_capacity && !grow_buckets(index)) return NULL;
+    size_t bucket = find_bucket(index, token, length);
+    if (index->buckets[bucket]) return &index->terms[index->buckets[bucket] - 1];
+
+    if (!grow_buffer((void**)&index->terms, &index->max_terms, index->num_terms + 1, sizeof(TextTerm), 64) ||
+        !grow_buffer((void**)&index->tokens, &index->tokens_capacity, index->tokens_size + length, 1, 4096)) {
+        return NULL;
+    }
+    TextTerm* term = &index->terms[index->num_terms];
+    memset(term, 0, sizeof(*term));
+    term->token_offset = (uint32_t)index->tokens_size;
+    term->token_length = (uint32_t)length;
+    memcpy(index->tokens + index->tokens_size, token, length);
+    index->tokens_size += length;
+    index->buckets[bucket] = (uint32_t)++index->num_terms;
+    return term;
+}
+
+static int add_posting(TextTerm* term, uint32_t row) {
+    if (term->count > 0 && term->last_row == row) return 1; // Word repeated within the row
+    if (!grow_buffer((void**)&term->postings, &term->capacity, term->size + VARINT_MAX_BYTES, 1, 16)) return 0;
+    term->size += put_varint(term->postings + term->size, term->count > 0 ? row - term->last_row : row);
+    term->last_row = row;
+    term->count++;
+    return 1;
+}
+
+int text_index_add(TextIndex* index, uint32_t row, const char* data, size_t length) {
+    const char* p = data;
+    const char* end = data + length;
+    char token[TEXT_TOKEN_MAX];
+    size_t token_length;
+    while ((token_length = next_token(&p, end, token)) > 0) {
+        TextTerm* term = intern_term(index, token, token_length);
+        if (!term || !add_posting(term, row)) return 0;
+    }
+    return 1;
+}
+
+// Keeps the entries of `rows` that also appear in `term`. Both are
+// ascending.
+static size_t intersect_postings(uint32_t* rows, size_t count, const TextTerm* term) {
+    const uint8_t* p = term->postings;
+    const uint8_t* end = p + term->size;
+    uint32_t row = 0;
+    uint32_t gap;
+    size_t kept = 0;
+    size_t i = 0;
+    int first = 1;
+    while (i < count && get_varint(&p, end, &gap)) {
+        row = first ? gap : row + gap;
+        first = 0;
+        while (i < count && rows[i] < row) i++;
+        if (i < count && rows[i] == row) rows[kept++] = rows[i++];
+    }
+    return kept;
+}
+
+int text_index_search(const TextIndex* index, const char* query, size_t length,
+                      uint32_t** rows, size_t* count) {
+    *rows = NULL;
+    *count = 0;
+
+    // Look every word up first; start from the rarest one. Words past the
+    // 64th are ignored.
+    const TextTerm* terms[64];
+    size_t num_terms = 0;
+    const char* p = query;
+    const char* end = query + length;
+    char token[TEXT_TOKEN_MAX];
+    size_t token_length;
+    while ((token_length = next_token(&p, end, token)) > 0) {
+        const TextTerm* term = find_term(index, token, token_length);
+        if (!term) return 1;
+        if (num_terms == sizeof(terms) / sizeof(terms[0])) break;
+        terms[num_terms++] = term;
+    }
+    if (num_terms == 0) return 1;
+
+    size_t rarest = 0;
+    for (size_t t = 1; t < num_terms; t++) {
+        if (terms[t]->count < terms[rarest]->count) rarest = t;
+    }
+
+    uint32_t* result = malloc(terms[rarest]->count * sizeof(uint32_t));
+    if (!result) return 0;
+    const uint8_t* q = terms[rarest]->postings;
+    const uint8_t* q_end = q + terms[rarest]->size;
+    uint32_t row = 0;
+    uint32_t gap;
+    size_t n = 0;
+    while (n < terms[rarest]->count && get_varint(&q, q_end, &gap)) {
+        row = n == 0 ? gap : row + gap;
+        result[n++] = row;
+    }
+    for (size_t t = 0; t < num_terms && n > 0; t++) {
+        if (t != rarest) n = intersect_postings(result, n, terms[t]);
+    }
+
+    *rows = result;
+    *count = n;
+    return 1;
+}
+
+int text_index_save(const TextIndex* index, const char* filename, uint32_t rows, uint32_t check) {
+    size_t body_size = 0;
+    for (size_t t = 0; t < index->num_terms; t++) {
+        body_size += 4 * VARINT_MAX_BYTES + index->terms[t].token_length + index->terms[t].size;
+    }
+    uint8_t* file = malloc(TEXT_INDEX_HEADER_SIZE + body_size);
+    if (!file) return 0;
+
+    // Each term: token length, token, row count, last row, postings size,
+    // postings.
+    uint8_t* body = file + TEXT_INDEX_HEADER_SIZE;
+    size_t size = 0;
+    for (size_t t = 0; t < index->num_terms; t++) {
+        const TextTerm* term = &index->terms[t];
+        size += put_varint(body + size, term->token_length);
+        memcpy(body + size, index->tokens + term->token_offset, term->token_length);
+        size += term->token_length;
+        size += put_varint(body + size, term->count);
+        size += put_varint(body + size, term->last_row);
+        size += put_varint(body + size, (uint32_t)term->size);
+        memcpy(body + size, term->postings, term->size);
+        size += term->size;
+    }
+
+    memset(file, 0, TEXT_INDEX_HEADER_SIZE);
+    memcpy(file, TEXT_INDEX_MAGIC, 8);
+    store_le32(file + 8, TEXT_INDEX_VERSION);
+    store_le32(file + 12, rows);
+    store_le32(file + 16, check);
+    store_le32(file + 20, (uint32_t)index->num_terms);
+    store_le32(file + 24, crc32c(body, size));
+
+    // Write a new file and move it into place so that a reader never sees
+    // half of one.
+    char tmp_name[4096];
+    snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", filename);
+    FILE* out = fopen(tmp_name, "wb");
+    int ok = out && fwrite(file, 1, TEXT_INDEX_HEADER_SIZE + size, out) == TEXT_INDEX_HEADER_SIZE + size;
+    if (out && fclose(out) != 0) ok = 0;
+    if (ok && rename(tmp_name, filename) != 0) ok = 0;
+    if (!ok) remove(tmp_name);
+    free(file);
+    return ok;
+}
+
+int text_index_load(TextIndex* index, const char* filename, uint32_t* rows, uint32_t* check) {
+    text_index_free(index);
+    FILE* in = fopen(filename, "rb");
+    if (!in) return 0;
+    fseek(in, 0, SEEK_END);
+    long file_size = ftell(in);
+    uint8_t* file = file_size >= TEXT_INDEX_HEADER_SIZE ? malloc((size_t)file_size) : NULL;
+    fseek(in, 0, SEEK_SET);
+    int ok = file && fread(file, 1, (size_t)file_size, in) == (size_t)file_size;
+    fclose(in);
+    if (!ok) {
+        free(file);
+        return 0;
+    }
+
+    const uint8_t* body = file + TEXT_INDEX_HEADER_SIZE;
+    size_t body_size = (size_t)file_size - TEXT_INDEX_HEADER_SIZE;
+    ok = memcmp(file, TEXT_INDEX_MAGIC, 8) == 0 && load_le32(file + 8) == TEXT_INDEX_VERSION &&
+         load_le32(file + 24) == crc32c(body, body_size);
+    *rows = load_le32(file + 12);
+    *check = load_le32(file + 16);
+
+    uint32_t num_terms = load_le32(file + 20);
+    const uint8_t* p = body;
+    const uint8_t* end = body + body_size;
+    for (uint32_t t = 0; ok && t < num_terms; t++) {
+        uint32_t token_length, count, last_row, size;
+        ok = get_varint(&p, end, &token_length) && token_length <= TEXT_TOKEN_MAX &&
+             (size_t)(end - p) >= token_length;
+        if (!ok) break;
+        const char* token = (const char*)p;
+        p += token_length;
+        ok = get_varint(&p, end, &count) && get_varint(&p, end, &last_row) &&
+             get_varint(&p, end, &size) && (size_t)(end - p) >= size;
+        if (!ok) break;
+
+        TextTerm* term = intern_term(index, token, token_length);
+        ok = term && term->count == 0 && count > 0 &&
+             grow_buffer((void**)&term->postings, &term->capacity, size, 1, 16);
+        if (!ok) break;
+        memcpy(term->postings, p, size);
+        term->size = size;
+        term->count = count;
+        term->last_row = last_row;
+        p += size;
+    }
+
+    free(file);
+    if (!ok) text_index_free(index);
+    return ok;
+}
@@ -0,0 +1,55 @@
+#include "wire.h"
+
+void wire_write_header(uint8_t* dest, uint32_t length, WireType type, uint32_t tag) {
+    store_le32(dest, length);
+    store_le32(dest + 4, (uint32_t)type);
+    store_le32(dest + 8, tag);
+}
+
+size_t wire_batch_size(const Event* events, size_t count) {
+    size_t size = WIRE_HEADER_SIZE + WIRE_BATCH_HEADER_SIZE + count * ROW_SIZE;
+    for (size_t i = 0; i < count; i++) {
+        size += heap_entry_size(&events[i]);
+    }
+    return size;
+}
+
+void wire_write_batch(uint8_t* dest, WireType type, uint32_t tag, uint32_t cursor,
+                      const Event* events, size_t count) {
+    wire_write_header(dest, (uint32_t)wire_batch_size(events, count), type, tag);
+    uint8_t* body = dest + WIRE_HEADER_SIZE;
+    store_le32(body, (uint32_t)count);
+    store_le32(body + 4, cursor);
+
+    uint8_t* records = body + WIRE_BATCH_HEADER_SIZE;
+    char* heap = (char*)(records + count * ROW_SIZE);
+    uint64_t heap_offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        char* entry = heap + heap_offset;
+        serialize_heap_entry(&events[i], entry);
+        serialize_event(&events[i], heap_offset, entry, records + i * ROW_SIZE);
+        heap_offset += heap_entry_size(&events[i]);
+    }
+}
+
+int wire_read_batch(const uint8_t* body, size_t length, Event* events, BlobHeap* overflow) {
+    if (length < WIRE_BATCH_HEADER_SIZE) return 0;
+    size_t count = wire_batch_count(body);
+    if (count > (length - WIRE_BATCH_HEADER_SIZE) / ROW_SIZE) return 0;
+
+    const uint8_t* records = body + WIRE_BATCH_HEADER_SIZE;
+    const char* heap = (const char*)(records + count * ROW_SIZE);
+    size_t heap_size = length - WIRE_BATCH_HEADER_SIZE - count * ROW_SIZE;
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* record = records + i * ROW_SIZE;
+        if (!record_valid(record) || !record_heap_valid(record, heap, heap_size)) return 0;
+        uint32_t* more_parents = NULL;
+        uint32_t overflow_count = record_overflow_count(record);
+        if (overflow_count > 0) {
+            more_parents = (uint32_t*)blob_heap_alloc(overflow, overflow_count * sizeof(uint32_t));
+            if (!more_parents) return 0;
+        }
+        deserialize_event(record, heap, more_parents, &events[i]);
+    }
+    return 1;
+}
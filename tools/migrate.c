@@ -0,0 +1,228 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../include/event.h"
+#include "../include/crc32c.h"
+
+// Converts a database file to the current on-disk format. The original
+// files are kept next to the result as <file>.bak and <file>.heap.bak.
+
+// Versions 0 to 2 allowed at most 8 parents.
+#define OLD_MAX_PARENTS 8
+
+// Version 0: no header, 168-byte rows in host byte order with the fields
+// packed back to back.
+#define V0_ROW_SIZE 168
+#define V0_PARENTS_OFFSET 5
+#define V0_DATA_OFFSET 37
+
+// Version 1: header, 192-byte little-endian rows with the payload inline
+// and a CRC-32C in the last four bytes.
+#define V1_ROW_SIZE 192
+#define V1_PARENTS_OFFSET 8
+#define V1_DATA_OFFSET 40
+#define V1_CRC_OFFSET (V1_ROW_SIZE - 4)
+#define V1_DATA_LENGTH 128
+
+// Version 2: header, 64-byte rows; payloads in the heap file, each
+// followed by a NUL.
+#define V2_ROW_SIZE 64
+#define V2_PARENTS_OFFSET 8
+#define V2_HEAP_OFFSET 40
+#define V2_DATA_LENGTH_OFFSET 48
+#define V2_DATA_CRC_OFFSET 52
+#define V2_CRC_OFFSET (V2_ROW_SIZE - 4)
+
+// Fills in the parents of `e` from `parents`, which must outlive it.
+static void set_parents(Event* e, const uint32_t* parents, uint32_t count) {
+    e->parent_count = count < OLD_MAX_PARENTS ? count : OLD_MAX_PARENTS;
+    for (uint32_t i = 0; i < INLINE_PARENTS; i++) {
+        e->parents[i] = parents[i];
+    }
+    e->more_parents = parents + INLINE_PARENTS;
+}
+
+static void decode_v0(const uint8_t* row, uint32_t* parents, Event* e) {
+    memcpy(&e->id, row, 4);
+    memcpy(parents, row + V0_PARENTS_OFFSET, 4 * OLD_MAX_PARENTS);
+    set_parents(e, parents, row[4]);
+    e->data = (const char*)row + V0_DATA_OFFSET;
+    e->data_length = (uint32_t)strnlen(e->data, V1_DATA_LENGTH);
+}
+
+// The decoders below return 0 for a row that fails its checksum; such
+// rows are dropped, as the loader would.
+static int decode_v1(const uint8_t* row, uint32_t* parents, Event* e) {
+    if (crc32c(row, V1_CRC_OFFSET) != load_le32(row + V1_CRC_OFFSET)) return 0;
+    e->id = load_le32(row);
+    for (int i = 0; i < OLD_MAX_PARENTS; i++) {
+        parents[i] = load_le32(row + V1_PARENTS_OFFSET + 4 * i);
+    }
+    set_parents(e, parents, row[4]);
+    e->data = (const char*)row + V1_DATA_OFFSET;
+    e->data_length = (uint32_t)strnlen(e->data, V1_DATA_LENGTH);
+    return 1;
+}
+
+static int decode_v2(const uint8_t* row, const char* heap, size_t heap_size, uint32_t* parents, Event* e) {
+    if (crc32c(row, V2_CRC_OFFSET) != load_le32(row + V2_CRC_OFFSET)) return 0;
+    uint64_t offset = load_le64(row + V2_HEAP_OFFSET);
+    uint32_t length = load_le32(row + V2_DATA_LENGTH_OFFSET);
+    if (length > MAX_DATA_LENGTH || offset >= heap_size || heap_size - offset <= length) return 0;
+    if (crc32c(heap + offset, length) != load_le32(row + V2_DATA_CRC_OFFSET)) return 0;
+    e->id = load_le32(row);
+    for (int i = 0; i < OLD_MAX_PARENTS; i++) {
+        parents[i] = load_le32(row + V2_PARENTS_OFFSET + 4 * i);
+    }
+    set_parents(e, parents, row[4]);
+    e->data = heap + offset;
+    e->data_length = length;
+    return 1;
+}
+
+// Reads all of `filename` into memory. A missing file reads as empty.
+static char* read_whole_file(const char* filename, size_t* size) {
+    *size = 0;
+    FILE* file = fopen(filename, "rb");
+    if (!file) return calloc(1, 1);
+    fseek(file, 0, SEEK_END);
+    *size = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* data = malloc(*size + 1);
+    if (data && fread(data, 1, *size, file) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+static int sync_and_close(FILE* file, const char* name) {
+    if (fflush(file) != 0 || fsync(fileno(file)) != 0) {
+        perror(name);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    return 1;
+}
+
+// Keeps `name` as `name`.bak, replacing any older backup.
+static int keep_backup(const char* name) {
+    char backup_name[4096];
+    snprintf(backup_name, sizeof(backup_name), "%.4090s.bak", name);
+    unlink(backup_name);
+    return link(name, backup_name) == 0 || access(name, F_OK) != 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <database file>\n", argv[0]);
+        return 1;
+    }
+    const char* filename = argv[1];
+
+    FILE* in = fopen(filename, "rb");
+    if (!in) {
+        perror(filename);
+        return 1;
+    }
+
+    uint8_t header[FILE_HEADER_SIZE];
+    size_t n = fread(header, 1, FILE_HEADER_SIZE, in);
+    uint32_t version = 0;
+    if (n == FILE_HEADER_SIZE && read_file_header(header, &version)) {
+        if (version == FORMAT_VERSION) {
+            printf("%s is already in format version %d.\n", filename, FORMAT_VERSION);
+            fclose(in);
+            return 0;
+        }
+        if (version != 1 && version != 2) {
+            fprintf(stderr, "%s: unknown format version %u\n", filename, version);
+            fclose(in);
+            return 1;
+        }
+    } else {
+        version = 0;
+        fseek(in, 0, SEEK_SET);
+    }
+    size_t row_size = version == 0 ? V0_ROW_SIZE : version == 1 ? V1_ROW_SIZE : V2_ROW_SIZE;
+
+    char heap_name[4096];
+    char tmp_name[4096];
+    char tmp_heap_name[4096];
+    heap_filename(filename, heap_name, sizeof(heap_name));
+    snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", filename);
+    snprintf(tmp_heap_name, sizeof(tmp_heap_name), "%s" HEAP_SUFFIX ".tmp", filename);
+
+    size_t old_heap_size = 0;
+    char* old_heap = version == 2 ? read_whole_file(heap_name, &old_heap_size) : NULL;
+    if (version == 2 && !old_heap) {
+        perror(heap_name);
+        fclose(in);
+        return 1;
+    }
+
+    FILE* out = fopen(tmp_name, "wb");
+    FILE* heap_out = fopen(tmp_heap_name, "wb");
+    if (!out || !heap_out) {
+        perror(tmp_name);
+        fclose(in);
+        return 1;
+    }
+    write_file_header(header);
+    fwrite(header, FILE_HEADER_SIZE, 1, out);
+
+    uint8_t row[V1_ROW_SIZE];
+    uint32_t parents[OLD_MAX_PARENTS];
+    char entry[4 * OLD_MAX_PARENTS + MAX_DATA_LENGTH + 1];
+    uint8_t record[ROW_SIZE];
+    uint64_t heap_offset = 0;
+    size_t rows = 0;
+    size_t dropped = 0;
+    while (fread(row, row_size, 1, in) == 1) {
+        Event e;
+        int decoded = 1;
+        if (version == 0) {
+            decode_v0(row, parents, &e);
+        } else if (version == 1) {
+            decoded = decode_v1(row, parents, &e);
+        } else {
+            decoded = decode_v2(row, old_heap, old_heap_size, parents, &e);
+        }
+        if (!decoded) {
+            dropped++;
+            continue;
+        }
+
+        size_t entry_size = heap_entry_size(&e);
+        serialize_heap_entry(&e, entry);
+        serialize_event(&e, heap_offset, entry, record);
+        if (fwrite(entry, 1, entry_size, heap_out) != entry_size || fwrite(record, ROW_SIZE, 1, out) != 1) {
+            perror(tmp_name);
+            return 1;
+        }
+        heap_offset += entry_size;
+        rows++;
+    }
+    fclose(in);
+    free(old_heap);
+
+    if (!sync_and_close(heap_out, tmp_heap_name) || !sync_and_close(out, tmp_name)) return 1;
+
+    // The heap goes into place first. Versions 0 and 1 ignore it, so an
+    // interrupted run can simply be repeated; a version 2 file needs its
+    // heap restored from the backup first.
+    if (!keep_backup(filename) || !keep_backup(heap_name) || rename(tmp_heap_name, heap_name) != 0 ||
+        rename(tmp_name, filename) != 0) {
+        perror(filename);
+        return 1;
+    }
+
+    printf("Migrated %zu events in %s from format version %u to %d (originals kept as .bak).\n",
+           rows, filename, version, FORMAT_VERSION);
+    if (dropped > 0) printf("Dropped %zu rows that failed their checksum.\n", dropped);
+    return 0;
+}